@@ -0,0 +1,224 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Access log.
+ *
+ * The server loop only copies a fixed-size binary record into a single
+ * producer, single consumer ring. A writer thread wakes up periodically,
+ * formats whatever accumulated and hands it to the kernel in one write(),
+ * so a slow console never stalls request handling.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "accesslog.h"
+
+#define RING_SIZE 1024			/* records, power of two */
+#define FLUSH_INTERVAL_NS 100000000	/* 100ms */
+#define LINE_MAX_SIZE 256
+
+struct log_record {
+	struct timespec time;
+	uint32_t duration_us;
+	uint16_t status;
+	uint16_t family;
+	uint8_t addr[16];
+	uint64_t bytes;
+	char method[8];
+	char uri[LOG_URI_SIZE];
+};
+
+static struct log_record ring[RING_SIZE];
+
+/* head is written by the producer only, tail by the consumer only */
+static unsigned int head;
+static unsigned int tail;
+static unsigned int dropped;
+
+static int log_fd = -1;
+static pthread_t writer_thread;
+static int stopping;
+
+
+void
+accesslog_record (const struct request *req, const struct sockaddr *addr)
+{
+	unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	struct log_record *r;
+
+	if (log_fd < 0)
+		return;
+
+	if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+		__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	r = &ring[h % RING_SIZE];
+
+	clock_gettime(CLOCK_REALTIME, &r->time);
+	r->duration_us = req->duration_us;
+	r->status = req->status;
+	r->bytes = req->bytes;
+	memcpy(r->method, req->method_name, sizeof r->method);
+	memcpy(r->uri, req->uri, sizeof r->uri);
+
+	r->family = addr ? addr->sa_family : AF_UNSPEC;
+	switch (r->family) {
+	case AF_INET:
+		memcpy(r->addr, &((const struct sockaddr_in *) addr)->sin_addr, 4);
+		break;
+	case AF_INET6:
+		memcpy(r->addr, &((const struct sockaddr_in6 *) addr)->sin6_addr, 16);
+		break;
+	}
+
+	__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+static size_t
+format_record (char *line, const struct log_record *r)
+{
+	char addr[INET6_ADDRSTRLEN];
+	char date[32];
+	struct tm tm;
+	int n;
+
+	switch (r->family) {
+	case AF_INET:
+	case AF_INET6:
+		inet_ntop(r->family, r->addr, addr, sizeof addr);
+		break;
+	case AF_UNIX:
+		strcpy(addr, "unix");
+		break;
+	default:
+		strcpy(addr, "-");
+		break;
+	}
+
+	gmtime_r(&r->time.tv_sec, &tm);
+	strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", &tm);
+
+	n = snprintf(line, LINE_MAX_SIZE, "%s.%03ldZ %s \"%.8s %.*s\" %u %llu %u.%03ums\n",
+		date, r->time.tv_nsec / 1000000, addr,
+		r->method, LOG_URI_SIZE, r->uri, r->status, (unsigned long long) r->bytes,
+		r->duration_us / 1000, r->duration_us % 1000);
+
+	return n < LINE_MAX_SIZE ? n : LINE_MAX_SIZE - 1;
+}
+
+static void
+write_all (const char *buffer, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(log_fd, buffer, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		buffer += n;
+		len -= n;
+	}
+}
+
+static void*
+writer (void *arg)
+{
+	static char buffer[64 * LINE_MAX_SIZE];
+	const struct timespec interval = { 0, FLUSH_INTERVAL_NS };
+
+	while (1) {
+		unsigned int t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		unsigned int h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		unsigned int lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+		size_t len = 0;
+
+		if (lost)
+			len += snprintf(buffer, sizeof buffer, "accesslog: %u records dropped\n", lost);
+
+		while (t != h) {
+			if (len + LINE_MAX_SIZE > sizeof buffer) {
+				write_all(buffer, len);
+				len = 0;
+			}
+
+			len += format_record(buffer + len, &ring[t % RING_SIZE]);
+			t++;
+
+			/* the slot is free for the producer once formatted */
+			__atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+		}
+
+		if (len)
+			write_all(buffer, len);
+
+		/* checked after a pass, so whatever came before the stop is out */
+		if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+			break;
+
+		nanosleep(&interval, NULL);
+	}
+
+	return NULL;
+}
+
+int
+accesslog_start (int fd)
+{
+	int err;
+
+	log_fd = fd;
+
+	if ((err = pthread_create(&writer_thread, NULL, writer, NULL)) != 0) {
+		log_fd = -1;
+		return -err;
+	}
+
+	return 0;
+}
+
+void
+accesslog_stop (void)
+{
+	if (log_fd < 0)
+		return;
+
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(writer_thread, NULL);
+	log_fd = -1;
+}
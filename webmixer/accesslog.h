@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <sys/socket.h>
+
+#include "router.h"
+
+/* start the writer thread, flushing formatted lines to fd */
+extern int accesslog_start (int fd);
+
+/* enqueue a completed request; never blocks, drops when the ring is full */
+extern void accesslog_record (const struct request *req, const struct sockaddr *addr);
+
+/* write out what is still in the ring and end the writer thread */
+extern void accesslog_stop (void);
+
+#endif
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <time.h>
+
+#include "admission.h"
+
+#define ADMISSION_QUEUE 16
+#define ADMISSION_DEADLINE_MS 1000
+
+/* the running estimate gives each new sample this weight, 1/8 */
+#define COST_SHIFT 3
+
+static struct timespec round_start;
+static int queued;
+
+/* expected cost of an expensive request, us */
+static uint32_t cost_us;
+
+
+static uint64_t
+since_round_us (void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - round_start.tv_sec) * 1000000LL +
+	       (now.tv_nsec - round_start.tv_nsec) / 1000;
+}
+
+void
+admission_round (void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &round_start);
+	queued = 0;
+}
+
+int
+admission_check (unsigned int *retry_after)
+{
+	uint64_t finish_us = since_round_us() + cost_us;
+
+	if (queued < ADMISSION_QUEUE && finish_us <= ADMISSION_DEADLINE_MS * 1000ULL) {
+		queued++;
+		return 1;
+	}
+
+	/* about when what is queued now will have drained */
+	*retry_after = 1 + (uint64_t) queued * cost_us / 1000000;
+
+	return 0;
+}
+
+void
+admission_cost (uint32_t duration_us)
+{
+	if (cost_us == 0)
+		cost_us = duration_us;
+	else
+		cost_us = cost_us - (cost_us >> COST_SHIFT) + (duration_us >> COST_SHIFT);
+}
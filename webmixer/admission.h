@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+/*
+ * Load shedding for the routes that enumerate the cards. Requests are
+ * served one after another within a select() round, so each expensive
+ * one admitted makes every later one in the round wait for it too. Past
+ * ADMISSION_QUEUE of them, or once the next would finish more than
+ * ADMISSION_DEADLINE_MS after the round began, the rest are turned away
+ * with 503 while cheap and cached routes carry on.
+ */
+
+/* a select() round starts: nothing queued yet */
+extern void admission_round (void);
+
+/* 1 to serve an expensive request, 0 to shed it, *retry_after in seconds */
+extern int admission_check (unsigned int *retry_after);
+
+/* an admitted request took duration_us */
+extern void admission_cost (uint32_t duration_us);
+
+#endif
@@ -23,9 +23,15 @@
 #include <asoundlib.h>
 #include <jansson.h>
 
-extern json_t* error(const char *fmt,...);
-
-static struct snd_mixer_selem_regopt
+#include "error.h"
+#include "metrics.h"
+#include "alsa.h"
+#include "groups.h"
+#include "ctl.h"
+#include "cards.h"
+#include "probes.h"
+
+static const struct snd_mixer_selem_regopt
 smixer_options = {
 	.ver = 1,
 	.abstract = SND_MIXER_SABSTRACT_NONE,
@@ -39,6 +45,12 @@ struct volume_ops {
 	
 enum { VOL_RAW, VOL_DB };
 
+struct switch_ops {
+	int (*has_switch)(snd_mixer_elem_t *elem);
+	int (*get)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c,
+		   int *value);
+};
+
 struct volume_ops_set {
 	int (*has_volume)(snd_mixer_elem_t *elem);
 	struct volume_ops v[2];
@@ -64,6 +76,66 @@ vol_ops[2] = {
 	},
 };
 
+static const struct switch_ops
+switch_ops[2] = {
+	{ snd_mixer_selem_has_playback_switch, snd_mixer_selem_get_playback_switch },
+	{ snd_mixer_selem_has_capture_switch, snd_mixer_selem_get_capture_switch },
+};
+
+const struct alsa_volume
+alsa_volume[2] = {
+	{
+		snd_mixer_selem_has_playback_volume,
+		snd_mixer_selem_has_playback_channel,
+		snd_mixer_selem_get_playback_volume_range,
+		snd_mixer_selem_get_playback_dB_range,
+		snd_mixer_selem_get_playback_volume,
+		snd_mixer_selem_get_playback_dB,
+		snd_mixer_selem_set_playback_volume,
+		snd_mixer_selem_set_playback_volume_all,
+		snd_mixer_selem_set_playback_dB,
+		snd_mixer_selem_set_playback_dB_all,
+		snd_mixer_selem_ask_playback_vol_dB,
+		snd_mixer_selem_ask_playback_dB_vol,
+	},
+	{
+		snd_mixer_selem_has_capture_volume,
+		snd_mixer_selem_has_capture_channel,
+		snd_mixer_selem_get_capture_volume_range,
+		snd_mixer_selem_get_capture_dB_range,
+		snd_mixer_selem_get_capture_volume,
+		snd_mixer_selem_get_capture_dB,
+		snd_mixer_selem_set_capture_volume,
+		snd_mixer_selem_set_capture_volume_all,
+		snd_mixer_selem_set_capture_dB,
+		snd_mixer_selem_set_capture_dB_all,
+		snd_mixer_selem_ask_capture_vol_dB,
+		snd_mixer_selem_ask_capture_dB_vol,
+	},
+};
+
+const char *alsa_direction_names[2] = { "playback", "capture" };
+
+int
+alsa_parse_channel (snd_mixer_elem_t *elem, int dir, const char *name)
+{
+	int chn;
+
+	if (name == NULL)
+		return ALL_CHANNELS;
+
+	if (!strcmp(name, "Mono"))
+		return alsa_volume[dir].has_channel(elem, SND_MIXER_SCHN_MONO) ? SND_MIXER_SCHN_MONO : NO_CHANNEL;
+
+	for (chn = 0; chn <= SND_MIXER_SCHN_LAST; chn++) {
+		if (alsa_volume[dir].has_channel(elem, chn) &&
+		    !strcmp(name, snd_mixer_selem_channel_name(chn)))
+			return chn;
+	}
+
+	return NO_CHANNEL;
+}
+
 static int
 convert_prange(long val, long min, long max)
 {
@@ -80,48 +152,112 @@ convert_prange(long val, long min, long max)
 static json_t*
 get_selem_volume(snd_mixer_elem_t *elem, 
 		  snd_mixer_selem_channel_id_t chn, int dir,
-		  long min, long max)
+		  long min, long max, struct select s)
 {
 	json_t *volume = json_object();
 
 	long raw, val;
-	vol_ops[dir].v[VOL_RAW].get(elem, chn, &raw);
-	val = convert_prange(raw, min, max);
 
-	json_object_set_new(volume, "raw", json_integer(raw));
-	json_object_set_new(volume, "perc", json_integer(val));
+	if (select_value(s, "raw") || select_value(s, "perc")) {
+		vol_ops[dir].v[VOL_RAW].get(elem, chn, &raw);
+
+		if (select_value(s, "raw"))
+			json_object_set_new(volume, "raw", json_integer(raw));
+		if (select_value(s, "perc"))
+			json_object_set_new(volume, "perc", json_integer(convert_prange(raw, min, max)));
+	}
 
-	if (!vol_ops[dir].v[VOL_DB].get(elem, chn, &val)) {
+	if (select_value(s, "dB") && !vol_ops[dir].v[VOL_DB].get(elem, chn, &val)) {
 		json_object_set_new(volume, "dB", json_integer(val));
 	}
 
 	return volume;
 }
 
+/* the "playback" or "capture" part of a channel; NULL when it has none */
+static json_t*
+get_selem_direction(snd_mixer_elem_t *elem,
+		    snd_mixer_selem_channel_id_t chn, int dir,
+		    long min, long max, struct select s)
+{
+	json_t *direction = NULL;
+	struct select sub;
+
+	if (!snd_mixer_selem_has_common_volume(elem) &&
+	    vol_ops[dir].has_volume(elem) && select_object(s, "volume", &sub)) {
+		direction = json_object();
+		json_object_set_new(direction, "volume", get_selem_volume(elem, chn, dir, min, max, sub));
+	}
+
+	if (!snd_mixer_selem_has_common_switch(elem) &&
+	    switch_ops[dir].has_switch(elem) && select_value(s, "switch")) {
+		int sw;
+
+		if (!direction)
+			direction = json_object();
+
+		switch_ops[dir].get(elem, chn, &sw);
+		json_object_set_new(direction, "switch", json_string(sw ? "on" : "off"));
+	}
+
+	return direction;
+}
+
+/* fill channel chn of value: common controls, then playback and capture */
+static void
+get_selem_channel(snd_mixer_elem_t *elem, json_t *channel,
+		  snd_mixer_selem_channel_id_t chn, int playback, int capture, int common,
+		  long pmin, long pmax, long cmin, long cmax, struct select s)
+{
+	struct select sub;
+	json_t *direction;
+
+	if (common && snd_mixer_selem_has_common_volume(elem) && select_object(s, "volume", &sub)) {
+		json_object_set_new(channel, "volume", get_selem_volume(elem, chn, 0, pmin, pmax, sub));
+	}
+	if (common && snd_mixer_selem_has_common_switch(elem) && select_value(s, "switch")) {
+		int sw;
+
+		snd_mixer_selem_get_playback_switch(elem, chn, &sw);
+		json_object_set_new(channel, "switch", json_string(sw ? "on" : "off"));
+	}
+
+	if (playback && select_object(s, "playback", &sub) &&
+	    (direction = get_selem_direction(elem, chn, 0, pmin, pmax, sub)))
+		json_object_set_new(channel, "playback", direction);
+
+	if (capture && select_object(s, "capture", &sub) &&
+	    (direction = get_selem_direction(elem, chn, 1, cmin, cmax, sub)))
+		json_object_set_new(channel, "capture", direction);
+}
+
 static json_t* 
-get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, const char *name)
+get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, const char *name,
+	  struct select s)
 {
 	snd_mixer_selem_channel_id_t chn;
-	long pmin, pmax;
-	long cmin, cmax;
+	long pmin = 0, pmax = 0;
+	long cmin = 0, cmax = 0;
 	int pmono, cmono;
 	snd_mixer_elem_t *elem;
 
 	json_t *selem = json_object();
 	json_t *value;
+	struct select limits_select, value_select;
+	int want_limits, want_value;
 
-	json_object_set_new(selem, "name", json_string(snd_mixer_selem_id_get_name(id)));
-	json_object_set_new(selem, "index", json_integer(snd_mixer_selem_id_get_index(id)));
+	if (select_value(s, "name"))
+		json_object_set_new(selem, "name", json_string(snd_mixer_selem_id_get_name(id)));
+	if (select_value(s, "index"))
+		json_object_set_new(selem, "index", json_integer(snd_mixer_selem_id_get_index(id)));
 
 	elem = snd_mixer_find_selem(handle, id);
 	if (!elem) {
-		json_object_set_new(selem, "error", error("Mixer %s simple element not found", name));
+		json_object_set_new(selem, "error", error(ERR_ALSA, "Mixer %s simple element not found", name));
 		return selem;
 	}
 
-	value = json_array();
-
-	{
+	if (select_value(s, "capabilities")) {
 		json_t *capabilities = json_array();
 
 		json_object_set_new(selem, "capabilities", capabilities);
@@ -176,33 +312,38 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 		unsigned int idx;
 		char altname[40];
 
-		json_t *alternatives = json_array();
+		if (select_value(s, "alternatives")) {
+			json_t *alternatives = json_array();
 
-		json_object_set_new(selem, "alternatives", alternatives);
+			json_object_set_new(selem, "alternatives", alternatives);
 
-		altcount = snd_mixer_selem_get_enum_items(elem);
-		for (i = 0; i < altcount; i++) {
-			snd_mixer_selem_get_enum_item_name(elem, i, sizeof(altname) - 1, altname);
-			json_array_append_new(alternatives, json_string(altname));
+			altcount = snd_mixer_selem_get_enum_items(elem);
+			for (i = 0; i < altcount; i++) {
+				snd_mixer_selem_get_enum_item_name(elem, i, sizeof(altname) - 1, altname);
+				json_array_append_new(alternatives, json_string(altname));
+			}
 		}
 
+		if (select_value(s, "value")) {
+			value = json_array();
 
-		for (i = 0; !snd_mixer_selem_get_enum_item(elem, i, &idx); i++) {
-			snd_mixer_selem_get_enum_item_name(elem, idx, sizeof(altname) - 1, altname);
-			json_array_append_new(value, json_string(altname));
-		}
+			for (i = 0; !snd_mixer_selem_get_enum_item(elem, i, &idx); i++) {
+				snd_mixer_selem_get_enum_item_name(elem, idx, sizeof(altname) - 1, altname);
+				json_array_append_new(value, json_string(altname));
+			}
 
-		json_object_set_new(selem, "value", value);
+			json_object_set_new(selem, "value", value);
+		}
 
 		return selem; /* no more thing to do */
 	}
 
-	if (snd_mixer_selem_has_capture_switch_exclusive(elem)) {
+	if (snd_mixer_selem_has_capture_switch_exclusive(elem) && select_value(s, "captureExclusiveGroup")) {
 		json_object_set_new(selem, "captureExclusiveGroup", json_integer(snd_mixer_selem_get_capture_group(elem)));
 	}
 
-	if (snd_mixer_selem_has_playback_volume(elem) ||
-	    snd_mixer_selem_has_playback_switch(elem)) {
+	if ((snd_mixer_selem_has_playback_volume(elem) ||
+	     snd_mixer_selem_has_playback_switch(elem)) && select_value(s, "playbackChannels")) {
 		json_t *playbackChannels = json_array();
 		json_object_set_new(selem, "playbackChannels", playbackChannels);
 
@@ -216,8 +357,8 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 		}
 	}
 
-	if (snd_mixer_selem_has_capture_volume(elem) ||
-	    snd_mixer_selem_has_capture_switch(elem)) {
+	if ((snd_mixer_selem_has_capture_volume(elem) ||
+	     snd_mixer_selem_has_capture_switch(elem)) && select_value(s, "captureChannels")) {
 		json_t *captureChannels = json_array();
 		json_object_set_new(selem, "captureChannels", captureChannels);
 
@@ -232,42 +373,58 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 		}
 	}
 
-	if (snd_mixer_selem_has_playback_volume(elem) ||
-	    snd_mixer_selem_has_capture_volume(elem)) {
-		json_t *limits = json_object();
-		json_object_set_new(selem, "limits", limits);
+	want_limits = select_object(s, "limits", &limits_select);
+	want_value = select_object(s, "value", &value_select);
 
-		if (snd_mixer_selem_has_common_volume(elem)) {
-			json_t *common = json_object();
-			json_object_set_new(limits, "common", common);
-			
+	/* value needs the ranges too, for perc */
+	if (want_limits || want_value) {
+		if (snd_mixer_selem_has_playback_volume(elem))
 			snd_mixer_selem_get_playback_volume_range(elem, &pmin, &pmax);
+		if (snd_mixer_selem_has_capture_volume(elem))
 			snd_mixer_selem_get_capture_volume_range(elem, &cmin, &cmax);
+	}
 
-			json_object_set_new(common, "min", json_integer(pmin));
-			json_object_set_new(common, "max", json_integer(pmax));
+	if ((snd_mixer_selem_has_playback_volume(elem) ||
+	     snd_mixer_selem_has_capture_volume(elem)) && want_limits) {
+		json_t *limits = json_object();
+		struct select range;
+		json_object_set_new(selem, "limits", limits);
+
+		if (snd_mixer_selem_has_common_volume(elem)) {
+			if (select_object(limits_select, "common", &range)) {
+				json_t *common = json_object();
+				json_object_set_new(limits, "common", common);
+
+				if (select_value(range, "min"))
+					json_object_set_new(common, "min", json_integer(pmin));
+				if (select_value(range, "max"))
+					json_object_set_new(common, "max", json_integer(pmax));
+			}
 		} else {
-			if (snd_mixer_selem_has_playback_volume(elem)) {
+			if (snd_mixer_selem_has_playback_volume(elem) && select_object(limits_select, "playback", &range)) {
 				json_t *playback = json_object();
 				json_object_set_new(limits, "playback", playback);
 
-				snd_mixer_selem_get_playback_volume_range(elem, &pmin, &pmax);
-
-				json_object_set_new(playback, "min", json_integer(pmin));
-				json_object_set_new(playback, "max", json_integer(pmax));
+				if (select_value(range, "min"))
+					json_object_set_new(playback, "min", json_integer(pmin));
+				if (select_value(range, "max"))
+					json_object_set_new(playback, "max", json_integer(pmax));
 			}
-			if (snd_mixer_selem_has_capture_volume(elem)) {
+			if (snd_mixer_selem_has_capture_volume(elem) && select_object(limits_select, "capture", &range)) {
 				json_t *capture = json_object();
 				json_object_set_new(limits, "capture", capture);
 
-				snd_mixer_selem_get_capture_volume_range(elem, &cmin, &cmax);
-
-				json_object_set_new(capture, "min", json_integer(cmin));
-				json_object_set_new(capture, "max", json_integer(cmax));
+				if (select_value(range, "min"))
+					json_object_set_new(capture, "min", json_integer(cmin));
+				if (select_value(range, "max"))
+					json_object_set_new(capture, "max", json_integer(cmax));
 			}
 		}
 	}
 
+	if (!want_value)
+		return selem;
+
 	pmono = snd_mixer_selem_has_playback_channel(elem, SND_MIXER_SCHN_MONO) &&
 	        (snd_mixer_selem_is_playback_mono(elem) || 
 		 (!snd_mixer_selem_has_playback_volume(elem) &&
@@ -284,6 +441,7 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 			snd_mixer_selem_has_capture_switch(elem));
 #endif
 
+	value = json_array();
 	json_object_set_new(selem, "value", value);
 
 	
@@ -291,73 +449,11 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 		json_t *mono = json_object();
 		json_array_append_new(value, mono);
 		
-		json_object_set_new(mono, "channel", json_string("Mono"));
-
-		if (snd_mixer_selem_has_common_volume(elem)) {
-			json_object_set_new(mono, "volume", get_selem_volume(elem, SND_MIXER_SCHN_MONO, 0, pmin, pmax));
-		}
-		if (snd_mixer_selem_has_common_switch(elem)) {
-			int sw;
-
-			snd_mixer_selem_get_playback_switch(elem, SND_MIXER_SCHN_MONO, &sw);
-			json_object_set_new(mono, "switch", json_string(sw ? "on" : "off"));
-		}
-
-		if (pmono) {
-			json_t *playback = NULL;
-
-			if (!snd_mixer_selem_has_common_volume(elem)) {
-				if (snd_mixer_selem_has_playback_volume(elem)) {
-					if (!playback) {
-						playback = json_object();
-						json_object_set_new(mono, "playback", playback);
-					}
-				
-					json_object_set_new(playback, "volume", get_selem_volume(elem, SND_MIXER_SCHN_MONO, 0, pmin, pmax));
-				}
-			}
-			if (!snd_mixer_selem_has_common_switch(elem)) {
-				if (snd_mixer_selem_has_playback_switch(elem)) {
-					int sw;
-
-					if (!playback) {
-						playback = json_object();
-						json_object_set_new(mono, "playback", playback);
-					}
-
-					snd_mixer_selem_get_playback_switch(elem, SND_MIXER_SCHN_MONO, &sw);
-					json_object_set_new(playback, "switch", json_string(sw ? "on" : "off"));
-				}
-			}
-		}
+		if (select_value(value_select, "channel"))
+			json_object_set_new(mono, "channel", json_string("Mono"));
 
-		if (cmono) {
-			json_t *capture = NULL;
-
-			if (!snd_mixer_selem_has_common_volume(elem)) {
-				if (snd_mixer_selem_has_capture_volume(elem)) {
-					if (!capture) {
-						capture = json_object();
-						json_object_set_new(mono, "capture", capture);
-					}
-
-					json_object_set_new(capture, "volume", get_selem_volume(elem, SND_MIXER_SCHN_MONO, 1, cmin, cmax));
-				}
-			}
-			if (!snd_mixer_selem_has_common_switch(elem)) {
-				if (snd_mixer_selem_has_capture_switch(elem)) {
-					int sw;
-
-					if (!capture) {
-						capture = json_object();
-						json_object_set_new(mono, "capture", capture);
-					}
-
-					snd_mixer_selem_get_capture_switch(elem, SND_MIXER_SCHN_MONO, &sw);
-					json_object_set_new(capture, "switch", json_string(sw ? "on" : "off"));
-				}
-			}
-		}
+		get_selem_channel(elem, mono, SND_MIXER_SCHN_MONO, pmono, cmono, 1,
+				  pmin, pmax, cmin, cmax, value_select);
 	}
 
 	if (!pmono || !cmono) {
@@ -369,206 +465,233 @@ get_selem(snd_mixer_t *handle, snd_mixer_selem_id_t *id, const char *space, cons
 				continue;
 
 			channel = json_object();
-			json_object_set_new(channel, "channel", json_string(snd_mixer_selem_channel_name(chn)));
+			if (select_value(value_select, "channel"))
+				json_object_set_new(channel, "channel", json_string(snd_mixer_selem_channel_name(chn)));
 			json_array_append_new(value, channel);
 
-			if (!pmono && !cmono && snd_mixer_selem_has_common_volume(elem)) {
-				json_object_set_new(channel, "volume", get_selem_volume(elem, chn, 0, pmin, pmax));
-			}
-			if (!pmono && !cmono && snd_mixer_selem_has_common_switch(elem)) {
-				int sw;
-
-				snd_mixer_selem_get_playback_switch(elem, chn, &sw);
-				json_object_set_new(channel, "switch", json_string(sw ? "on" : "off"));
-			}
-			if (!pmono && snd_mixer_selem_has_playback_channel(elem, chn)) {
-				json_t *playback = NULL;
-
-				if (!snd_mixer_selem_has_common_volume(elem)) {
-					if (snd_mixer_selem_has_playback_volume(elem)) {
-						if (!playback) {
-							playback = json_object();
-							json_object_set_new(channel, "playback", playback);
-						}
-
-						json_object_set_new(playback, "volume", get_selem_volume(elem, chn, 0, pmin, pmax));
-					}
-				}
-				if (!snd_mixer_selem_has_common_switch(elem)) {
-					if (snd_mixer_selem_has_playback_switch(elem)) {
-						int sw;
-
-						if (!playback) {
-							playback = json_object();
-							json_object_set_new(channel, "playback", playback);
-						}
-
-						snd_mixer_selem_get_playback_switch(elem, chn, &sw);
-						json_object_set_new(playback, "switch", json_string(sw ? "on" : "off"));
-					}
-				}
-			}
-			if (!cmono && snd_mixer_selem_has_capture_channel(elem, chn)) {
-				json_t *capture = NULL;
-
-				if (!snd_mixer_selem_has_common_volume(elem)) {
-					if (snd_mixer_selem_has_capture_volume(elem)) {
-						if (!capture) {
-							capture = json_object();
-							json_object_set_new(channel, "capture", capture);
-						}
-
-						json_object_set_new(capture, "volume", get_selem_volume(elem, chn, 1, cmin, cmax));
-					}
-				}
-				if (!snd_mixer_selem_has_common_switch(elem)) {
-					if (snd_mixer_selem_has_capture_switch(elem)) {
-						int sw;
-
-						if (!capture) {
-							capture = json_object();
-							json_object_set_new(channel, "capture", capture);
-						}
-
-						snd_mixer_selem_get_capture_switch(elem, chn, &sw);
-						json_object_set_new(capture, "switch", json_string(sw ? "on" : "off"));
-					}
-				}
-			}
+			get_selem_channel(elem, channel, chn,
+					  !pmono && snd_mixer_selem_has_playback_channel(elem, chn),
+					  !cmono && snd_mixer_selem_has_capture_channel(elem, chn),
+					  !pmono && !cmono,
+					  pmin, pmax, cmin, cmax, value_select);
 		}
 	}
 
 	return selem;
 }
 
-static json_t*
-get_card_mixer (const char *name)
+/* safe to call from several threads, for different handles */
+int
+alsa_mixer_open (const char *name, snd_mixer_t **handle, const char **stage)
 {
+	struct snd_mixer_selem_regopt options = smixer_options;
+	struct timespec start;
 	int err;
-	snd_mixer_t *handle;
-	snd_mixer_selem_id_t *sid;
-	snd_mixer_elem_t *elem;
 
-	json_t *mixer;
+	*stage = "open";
+	if ((err = snd_mixer_open(handle, 0)) < 0)
+		return err;
 
-	snd_mixer_selem_id_alloca(&sid);
-	
-	if ((err = snd_mixer_open(&handle, 0)) < 0) {
-		return error("Mixer %s open error: %s", name, snd_strerror(err));
+	options.device = name;
+
+	*stage = "register";
+	if ((err = snd_mixer_selem_register(*handle, &options, NULL)) < 0) {
+		snd_mixer_close(*handle);
+		return err;
 	}
 
-	smixer_options.device = name;
+	metrics_start(&start);
+	err = snd_mixer_load(*handle);
+	metrics_time(TIMER_MIXER_LOAD, &start);
 
-	if ((err = snd_mixer_selem_register(handle, &smixer_options, NULL)) < 0) {
-		snd_mixer_close(handle);
-		return error("Mixer register error: %s", snd_strerror(err));
+	*stage = "load";
+	if (err < 0) {
+		snd_mixer_close(*handle);
+		return err;
 	}
 
-	if ((err = snd_mixer_load(handle)) < 0) {
-		snd_mixer_close(handle);
-		return error("Mixer %s load error: %s", name, snd_strerror(err));
+	return 0;
+}
+
+snd_mixer_t*
+alsa_open_mixer (const char *name, json_t **err_node)
+{
+	snd_mixer_t *handle;
+	const char *stage;
+	int err;
+
+	if ((err = alsa_mixer_open(name, &handle, &stage)) < 0) {
+		*err_node = error(ERR_ALSA, "Mixer %s %s error: %s", name, stage, snd_strerror(err));
+		return NULL;
 	}
 
+	return handle;
+}
+
+static json_t*
+get_card_mixer (const char *name, struct select s)
+{
+	snd_mixer_t *handle;
+	snd_mixer_selem_id_t *sid;
+	snd_mixer_elem_t *elem;
+	size_t i;
+
+	json_t *mixer;
+
+	snd_mixer_selem_id_alloca(&sid);
+	
+	PROBE1(mixer__open, name);
+	if ((handle = alsa_open_mixer(name, &mixer)) == NULL)
+		return mixer;
+	PROBE1(mixer__loaded, name);
+
 	mixer = json_array();
-	for (elem = snd_mixer_first_elem(handle); elem; elem = snd_mixer_elem_next(elem)) {
+	for (elem = snd_mixer_first_elem(handle), i = 0; elem; elem = snd_mixer_elem_next(elem), i++) {
 		json_t *selem;
 
+		/* keep the indexes of what was not asked for */
+		if (!select_index(s, i)) {
+			json_array_append_new(mixer, json_null());
+			continue;
+		}
+
 		snd_mixer_selem_get_id(elem, sid);
 
-		selem = get_selem(handle, sid, "  ", name);
-		if (!snd_mixer_selem_is_active(elem))
+		/* (card, element index): /alsa/cards/N/mixer/i */
+		PROBE2(selem, name, i);
+		selem = get_selem(handle, sid, "  ", name, s);
+		if (!snd_mixer_selem_is_active(elem) && select_value(s, "inactive"))
 			json_object_set_new(selem, "inactive", json_true());
 
 		json_array_append_new(mixer, selem);
 	}
 	snd_mixer_close(handle);
+	PROBE2(mixer__done, name, i);
 
 	return mixer;
 }
 
+json_t*
+get_mixer (int number, struct select s)
+{
+	char name[32];
+
+	snprintf(name, sizeof name, "hw:%d", number);
+
+	return get_card_mixer(name, s);
+}
+
+static const struct card_info {
+	const char *key;
+	const char* (*get)(const snd_ctl_card_info_t *info);
+}
+card_info[] = {
+	{ "id", snd_ctl_card_info_get_id },
+	{ "driver", snd_ctl_card_info_get_driver },
+	{ "name", snd_ctl_card_info_get_name },
+	{ "longname", snd_ctl_card_info_get_longname },
+	{ "mixername", snd_ctl_card_info_get_mixername },
+	{ "components", snd_ctl_card_info_get_components },
+};
+
+#define CARD_INFO (sizeof(card_info)/sizeof(card_info[0]))
+
 static json_t*
-get_card (const char *name)
+get_card (int number, const char *name, struct select s)
 {
-	int err;
+	int i, want_info = 0;
 
-	snd_ctl_t *handle;
-	snd_ctl_card_info_t *info;
+	const snd_ctl_card_info_t *info;
 
 	json_t *card;
 	json_t *mixer;
+	struct select sub;
 
 
-	snd_ctl_card_info_alloca(&info);
+	PROBE2(card__start, number, name);
 
+	card = json_object();
+
+	for (i = 0; i < CARD_INFO; i++)
+		want_info |= select_value(s, card_info[i].key);
 
-	if ((err = snd_ctl_open(&handle, name, 0)) < 0) {
-		return error("control open (%s): %s", name, snd_strerror(err));
+	/* read once when the card appeared, see cards.c */
+	if (want_info) {
+		if ((info = cards_info(number)) == NULL) {
+			json_decref(card);
+			return error(ERR_NO_DEVICE, "control open (%s) failed", name);
+		}
+
+		for (i = 0; i < CARD_INFO; i++) {
+			if (select_value(s, card_info[i].key))
+				json_object_set_new(card, card_info[i].key, json_string(card_info[i].get(info)));
+		}
 	}
 
-	if ((err = snd_ctl_card_info(handle, info)) < 0) {
-		snd_ctl_close(handle);
-		return error("control hardware info (%s): %s", name, snd_strerror(err));
+	if (select_object(s, "mixer", &sub)) {
+		mixer = get_card_mixer(name, sub);
+		json_object_set_new(card, "mixer", mixer);
 	}
 
-	card = json_object();
-	json_object_set_new(card, "id", json_string(snd_ctl_card_info_get_id(info)));	
-	json_object_set_new(card, "driver", json_string(snd_ctl_card_info_get_driver(info)));
-	json_object_set_new(card, "name", json_string(snd_ctl_card_info_get_name(info)));
-	json_object_set_new(card, "longname", json_string(snd_ctl_card_info_get_longname(info)));
-	json_object_set_new(card, "mixername", json_string(snd_ctl_card_info_get_mixername(info)));
-	json_object_set_new(card, "components", json_string(snd_ctl_card_info_get_components(info)));
-	snd_ctl_close(handle);
+	if (ctl_enabled() && select_object(s, "controls", &sub))
+		json_object_set_new(card, "controls", ctl_controls(number, sub));
 
-	mixer = get_card_mixer(name);
-	json_object_set_new(card, "mixer", mixer);
+	PROBE1(card__done, number);
 
 	return card;
 }
 
 static json_t* 
-get_cards(void)
+get_cards(struct select s)
 {
-	int err;
 	int card;
 
 	json_t *cards;
 
-	card = -1;
-	if ((err = snd_card_next(&card)) < 0 || card < 0) {
-		return error("no soundcards found...");
+	if ((card = cards_next(-1)) < 0) {
+		return error(ERR_NO_DEVICE, "no soundcards found...");
 	}
 
 	cards = json_array();
-	while (card >= 0) {
+	for (; card >= 0; card = cards_next(card)) {
 		char name[32];
 		snprintf(name, sizeof name, "hw:%d", card);
 
-		{
-			json_t *card;
-			card = get_card(name);
-
-			json_array_append_new(cards, card);
-		}
-
-		if ((err = snd_card_next(&card)) < 0) {
-			json_array_append_new(cards, error("snd_card_next"));
-			break;
-		}
+		if (!select_index(s, json_array_size(cards)))
+			json_array_append_new(cards, json_null());
+		else
+			json_array_append_new(cards, get_card(card, name, s));
 	}
 
 	return cards;
 }
 
 json_t* 
-get_alsa(void)
+get_alsa(struct select s)
 {
 	json_t *root = json_object();
-	json_t *alsa = json_object();
-	json_t *cards = get_cards();
+	json_t *alsa;
+	json_t *cards;
+	struct select sub;
+	struct timespec start;
+
+	if (!select_object(s, "alsa", &s))
+		return root;
 
-	json_object_set_new(alsa, "cards", cards);
+	alsa = json_object();
 	json_object_set_new(root, "alsa", alsa);
 
+	if (select_object(s, "cards", &sub)) {
+		metrics_start(&start);
+		cards = get_cards(sub);
+		metrics_time(TIMER_GET_CARDS, &start);
+
+		json_object_set_new(alsa, "cards", cards);
+	}
+
+	if (select_object(s, "groups", &sub))
+		json_object_set_new(alsa, "groups", groups_tree(sub));
+
 	return root;
 }
 
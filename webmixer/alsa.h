@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ALSA_H
+#define ALSA_H
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "select.h"
+
+/* the /alsa tree, holding what s selects */
+extern json_t* get_alsa (struct select s);
+
+/* the "mixer" of card number alone */
+extern json_t* get_mixer (int number, struct select s);
+
+/* playback ([0]) and capture ([1]) volume accessors of alsa-lib */
+struct alsa_volume {
+	int (*has_volume)(snd_mixer_elem_t *elem);
+	int (*has_channel)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c);
+	int (*get_range)(snd_mixer_elem_t *elem, long *min, long *max);
+	int (*get_dB_range)(snd_mixer_elem_t *elem, long *min, long *max);
+	int (*get)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c, long *value);
+	int (*get_dB)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c, long *value);
+	int (*set)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c, long value);
+	int (*set_all)(snd_mixer_elem_t *elem, long value);
+	int (*set_dB)(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t c, long value, int dir);
+	int (*set_dB_all)(snd_mixer_elem_t *elem, long value, int dir);
+	int (*ask_vol_dB)(snd_mixer_elem_t *elem, long value, long *dB);
+	int (*ask_dB_vol)(snd_mixer_elem_t *elem, long dB, int dir, long *value);
+};
+
+extern const struct alsa_volume alsa_volume[2];
+
+/* "playback" and "capture", as indexes of alsa_volume */
+extern const char *alsa_direction_names[2];
+
+/* no channel given: every channel of the element */
+#define ALL_CHANNELS -1
+#define NO_CHANNEL -2
+
+/* channel id of name ("Front Left", "Mono") in direction dir, NO_CHANNEL if elem lacks it */
+extern int alsa_parse_channel (snd_mixer_elem_t *elem, int dir, const char *name);
+
+/* open and load the simple mixer of card name ("hw:N"); NULL and *err on failure */
+extern snd_mixer_t* alsa_open_mixer (const char *name, json_t **err);
+
+/* the same without building JSON, for threads; *stage names the failing step */
+extern int alsa_mixer_open (const char *name, snd_mixer_t **handle, const char **stage);
+
+#endif
@@ -0,0 +1,259 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "amixer.h"
+
+void
+text_printf (struct text *t, const char *format, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, format);
+	n = vsnprintf(t->data ? t->data + t->len : NULL, t->size - t->len, format, ap);
+	va_end(ap);
+
+	if (n < 0)
+		return;
+
+	if (t->len + n >= t->size) {
+		t->size = (t->len + n + 1) * 2;
+		t->data = realloc(t->data, t->size);
+
+		va_start(ap, format);
+		vsnprintf(t->data + t->len, t->size - t->len, format, ap);
+		va_end(ap);
+	}
+
+	t->len += n;
+}
+
+int
+text_write (struct text *t, int fd)
+{
+	size_t done = 0;
+
+	while (done < t->len) {
+		ssize_t n = write(fd, t->data + done, t->len - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		done += n;
+	}
+
+	t->len = 0;
+
+	return 0;
+}
+
+static const char*
+string (json_t *object, const char *key)
+{
+	const char *s = json_string_value(json_object_get(object, key));
+
+	return s ? s : "";
+}
+
+/* " 40 [63%] [-12.50dB]": dB comes in hundredths */
+static void
+put_volume (struct text *t, json_t *volume)
+{
+	json_t *db = json_object_get(volume, "dB");
+
+	text_printf(t, " %" JSON_INTEGER_FORMAT " [%" JSON_INTEGER_FORMAT "%%]",
+		    json_integer_value(json_object_get(volume, "raw")),
+		    json_integer_value(json_object_get(volume, "perc")));
+
+	if (db) {
+		json_int_t dbv = json_integer_value(db);
+
+		text_printf(t, " [%s%" JSON_INTEGER_FORMAT ".%02" JSON_INTEGER_FORMAT "dB]",
+			    dbv < 0 ? "-" : "", (dbv < 0 ? -dbv : dbv) / 100, (dbv < 0 ? -dbv : dbv) % 100);
+	}
+}
+
+/* " Playback 40 [63%] [on]", nothing when the channel has neither */
+static void
+put_direction (struct text *t, const char *label, json_t *direction)
+{
+	json_t *volume = json_object_get(direction, "volume");
+	json_t *sw = json_object_get(direction, "switch");
+
+	if (volume || sw)
+		text_printf(t, " %s", label);
+	if (volume)
+		put_volume(t, volume);
+	if (sw)
+		text_printf(t, " [%s]", json_string_value(sw));
+}
+
+static void
+put_channels (struct text *t, const char *label, json_t *channels)
+{
+	const char *sep = "";
+	json_t *channel;
+	size_t i;
+
+	text_printf(t, "  %s channels:", label);
+	json_array_foreach(channels, i, channel) {
+		text_printf(t, "%s %s", sep, json_string_value(channel));
+		sep = " -";
+	}
+	text_printf(t, "\n");
+}
+
+static void
+put_range (struct text *t, const char *label, json_t *range)
+{
+	text_printf(t, "%s %" JSON_INTEGER_FORMAT " - %" JSON_INTEGER_FORMAT, label,
+		    json_integer_value(json_object_get(range, "min")),
+		    json_integer_value(json_object_get(range, "max")));
+}
+
+void
+amixer_card_header (struct text *t, json_t *card)
+{
+	text_printf(t, "card\n");
+	text_printf(t, "get_id: %s\n", string(card, "id"));
+	text_printf(t, "get_driver: %s\n", string(card, "driver"));
+	text_printf(t, "get_name: %s\n", string(card, "name"));
+	text_printf(t, "get_longname: %s\n", string(card, "longname"));
+	text_printf(t, "get_mixername: %s\n", string(card, "mixername"));
+	text_printf(t, "get_components: %s\n", string(card, "components"));
+
+	text_printf(t, "card %s: %s [%s]\n", "**LOST**", string(card, "id"), string(card, "name"));
+}
+
+void
+amixer_selem (struct text *t, json_t *selem)
+{
+	json_t *capabilities = json_object_get(selem, "capabilities");
+	json_t *values = json_object_get(selem, "value");
+	json_t *group, *channels, *limits;
+	json_t *value;
+	size_t i;
+	int is_enum = 0;
+
+	if (json_object_get(selem, "inactive") == json_true())
+		text_printf(t, "[INACTIVE] ");
+
+	text_printf(t, "Simple mixer control '%s',%i\n", string(selem, "name"),
+		    (int) json_integer_value(json_object_get(selem, "index")));
+
+	text_printf(t, "  Capabilities:");
+	json_array_foreach(capabilities, i, value) {
+		const char *cap = json_string_value(value);
+
+		if (cap == NULL)
+			continue;
+		is_enum |= !strcmp("enum", cap) || !strcmp("penum", cap) || !strcmp("cenum", cap);
+		text_printf(t, " %s", cap);
+	}
+	text_printf(t, "\n");
+
+	if (is_enum) {
+		text_printf(t, "  Items:");
+		json_array_foreach(json_object_get(selem, "alternatives"), i, value)
+			text_printf(t, " '%s'", json_string_value(value));
+		text_printf(t, "\n");
+
+		json_array_foreach(values, i, value)
+			text_printf(t, "  Item%zu: '%s'\n", i, json_string_value(value));
+
+		return;
+	}
+
+	if ((group = json_object_get(selem, "captureExclusiveGroup")))
+		text_printf(t, "  Capture exclusive group: %" JSON_INTEGER_FORMAT "\n", json_integer_value(group));
+
+	if ((channels = json_object_get(selem, "playbackChannels")))
+		put_channels(t, "Playback", channels);
+	if ((channels = json_object_get(selem, "captureChannels")))
+		put_channels(t, "Capture", channels);
+
+	if ((limits = json_object_get(selem, "limits"))) {
+		json_t *common = json_object_get(limits, "common");
+		json_t *range;
+
+		text_printf(t, "  Limits:");
+		if (common) {
+			put_range(t, "", common);
+		} else {
+			if ((range = json_object_get(limits, "playback")))
+				put_range(t, " Playback", range);
+			if ((range = json_object_get(limits, "capture")))
+				put_range(t, " Capture", range);
+		}
+		text_printf(t, "\n");
+	}
+
+	json_array_foreach(values, i, value) {
+		json_t *volume = json_object_get(value, "volume");
+		json_t *sw = json_object_get(value, "switch");
+
+		text_printf(t, "  %s:", string(value, "channel"));
+
+		if (volume)
+			put_volume(t, volume);
+		if (sw)
+			text_printf(t, " [%s]", json_string_value(sw));
+
+		put_direction(t, "Playback", json_object_get(value, "playback"));
+		put_direction(t, "Capture", json_object_get(value, "capture"));
+		text_printf(t, "\n");
+	}
+}
+
+void
+amixer_card (struct text *t, json_t *card)
+{
+	json_t *selem;
+	size_t i;
+
+	amixer_card_header(t, card);
+
+	json_array_foreach(json_object_get(card, "mixer"), i, selem) {
+		/* left out by a selection, see get_card_mixer() */
+		if (json_is_object(selem))
+			amixer_selem(t, selem);
+	}
+}
+
+void
+amixer_cards (struct text *t, json_t *cards)
+{
+	json_t *card;
+	size_t i;
+
+	json_array_foreach(cards, i, card) {
+		if (json_is_object(card))
+			amixer_card(t, card);
+	}
+}
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef AMIXER_H
+#define AMIXER_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+/*
+ * amixer's text from the /alsa tree, for /alsa.txt and decodejson alike.
+ * Elements render from the JSON of get_selem(): the members printed are
+ * AMIXER_FIELDS, what /alsa.txt asks get_alsa() to enumerate.
+ */
+
+#define AMIXER_FIELDS "id,driver,name,longname,mixername,components,mixer"
+
+/* text appended to; data is malloc()ed, not NUL terminated */
+struct text {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+extern void text_printf (struct text *t, const char *format, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+/* write all of t to fd and empty it; -1 with errno on failure */
+extern int text_write (struct text *t, int fd);
+
+/* the lines heading a card, from the scalar members of card */
+extern void amixer_card_header (struct text *t, json_t *card);
+
+/* a "Simple mixer control" block, for an element of a card's "mixer" */
+extern void amixer_selem (struct text *t, json_t *selem);
+
+/* the header, then every element */
+extern void amixer_card (struct text *t, json_t *card);
+
+/* every card of an /alsa/cards array */
+extern void amixer_cards (struct text *t, json_t *cards);
+
+#endif
@@ -0,0 +1,541 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Static asset cache.
+ *
+ * Files under the document root are read once, on first request, together
+ * with their precompressed siblings. Each variant keeps a ready MHD
+ * response with Content-Type, ETag, Last-Modified and Cache-Control
+ * already attached, so a repeated hit is a hash lookup and a queue. An
+ * inotify watch on each directory holding a cached file drops entries as
+ * soon as the file (or one of its siblings) changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <microhttpd.h>
+
+#include "assets.h"
+#include "compress.h"
+
+#define ASSET_BUCKETS 256
+#define MAX_WATCHES 64
+#define MAX_IN_RAM (1024 * 1024)
+#define CACHE_CONTROL "public, max-age=300"
+#define ETAG_SIZE 48
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | \
+		    IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF)
+
+struct asset {
+	char *url;
+	unsigned int hash;
+
+	/* indexed by encoding, NULL when there is no such variant */
+	struct MHD_Response *response[ENC_COUNT];
+	struct MHD_Response *not_modified[ENC_COUNT];
+	char etag[ENC_COUNT][ETAG_SIZE];
+	size_t size[ENC_COUNT];
+
+	struct asset *next;
+};
+
+static const struct mime {
+	const char *suffix;
+	const char *type;
+}
+mimes[] = {
+	{ ".html", "text/html; charset=utf-8" },
+	{ ".htm", "text/html; charset=utf-8" },
+	{ ".css", "text/css; charset=utf-8" },
+	{ ".js", "application/javascript; charset=utf-8" },
+	{ ".json", "application/json" },
+	{ ".txt", "text/plain; charset=utf-8" },
+	{ ".svg", "image/svg+xml" },
+	{ ".png", "image/png" },
+	{ ".jpg", "image/jpeg" },
+	{ ".jpeg", "image/jpeg" },
+	{ ".gif", "image/gif" },
+	{ ".ico", "image/x-icon" },
+	{ ".woff", "font/woff" },
+	{ ".woff2", "font/woff2" },
+};
+
+static const char *variant_suffix[ENC_COUNT] = {
+	[ENC_IDENTITY] = "",
+	[ENC_GZIP] = ".gz",
+	[ENC_BR] = ".br",
+};
+
+static char *docroot = ".";
+static int inotify_fd = -1;
+
+static struct asset *buckets[ASSET_BUCKETS];
+
+static struct watch {
+	int wd;
+	char *dir;	/* url prefix, with trailing slash */
+}
+watches[MAX_WATCHES];
+static int nwatches;
+
+
+static unsigned int
+hash_url (const char *url, size_t len)
+{
+	unsigned int hash = 5381;
+
+	while (len--)
+		hash = hash * 33 + (unsigned char) *url++;
+
+	return hash;
+}
+
+static const char*
+mime_type (const char *url)
+{
+	size_t len = strlen(url);
+	int i;
+
+	for (i = 0; i < sizeof(mimes)/sizeof(mimes[0]); i++) {
+		size_t slen = strlen(mimes[i].suffix);
+
+		if (len > slen && !strcasecmp(url + len - slen, mimes[i].suffix))
+			return mimes[i].type;
+	}
+
+	return "application/octet-stream";
+}
+
+/* reject anything that could step outside the document root */
+static int
+safe_url (const char *url)
+{
+	const char *p;
+
+	if (url[0] != '/')
+		return 0;
+
+	for (p = url; (p = strstr(p, "..")) != NULL; p += 2) {
+		if (p[-1] == '/' && (p[2] == '/' || p[2] == '\0'))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void
+watch_dir (const char *url)
+{
+	const char *slash = strrchr(url, '/');
+	size_t len = slash - url + 1;
+	char path[PATH_MAX];
+	int i, wd;
+
+	if (inotify_fd < 0)
+		return;
+
+	for (i = 0; i < nwatches; i++) {
+		if (strlen(watches[i].dir) == len && !strncmp(watches[i].dir, url, len))
+			return;
+	}
+
+	if (nwatches == MAX_WATCHES) {
+		fprintf(stderr, "assets: too many directories to watch, %.*s will not be cached\n", (int) len, url);
+		return;
+	}
+
+	snprintf(path, sizeof path, "%s%.*s", docroot, (int) len, url);
+	if ((wd = inotify_add_watch(inotify_fd, path, WATCH_MASK)) < 0) {
+		fprintf(stderr, "assets: inotify_add_watch(%s): %s\n", path, strerror(errno));
+		return;
+	}
+
+	watches[nwatches].wd = wd;
+	watches[nwatches].dir = strndup(url, len);
+	nwatches++;
+}
+
+static int
+is_watched (const char *url)
+{
+	const char *slash = strrchr(url, '/');
+	size_t len = slash - url + 1;
+	int i;
+
+	for (i = 0; i < nwatches; i++) {
+		if (strlen(watches[i].dir) == len && !strncmp(watches[i].dir, url, len))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+format_etag (char *etag, size_t etag_size, const struct stat *st, enum encoding encoding)
+{
+	snprintf(etag, etag_size, "\"%lx-%lx%s\"",
+		 (unsigned long) st->st_mtime, (unsigned long) st->st_size, variant_suffix[encoding]);
+}
+
+static struct MHD_Response*
+load_variant (const char *url, enum encoding encoding, char *etag, size_t etag_size,
+	      size_t *size)
+{
+	char path[PATH_MAX];
+	char date[64];
+	struct stat st;
+	struct MHD_Response *response;
+	int fd;
+
+	snprintf(path, sizeof path, "%s%s%s", docroot, url, variant_suffix[encoding]);
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if (st.st_size <= MAX_IN_RAM) {
+		char *body = malloc(st.st_size ? st.st_size : 1);
+		ssize_t n = 0, r;
+
+		while (n < st.st_size && (r = read(fd, body + n, st.st_size - n)) > 0)
+			n += r;
+		close(fd);
+
+		if (n != st.st_size) {
+			free(body);
+			errno = EIO;
+			return NULL;
+		}
+
+		response = MHD_create_response_from_buffer (st.st_size, body, MHD_RESPMEM_MUST_FREE);
+	} else {
+		/* too big to keep in RAM: the response owns the fd and sendfile()s it */
+		response = MHD_create_response_from_fd (st.st_size, fd);
+	}
+
+	*size = st.st_size;
+
+	strftime(date, sizeof date, "%a, %d %b %Y %H:%M:%S GMT", gmtime(&st.st_mtime));
+	format_etag(etag, etag_size, &st, encoding);
+
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, mime_type(url));
+	MHD_add_response_header (response, MHD_HTTP_HEADER_ETAG, etag);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_LAST_MODIFIED, date);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CACHE_CONTROL, CACHE_CONTROL);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+	if (encoding != ENC_IDENTITY)
+		MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_ENCODING, encoding_name[encoding]);
+
+	return response;
+}
+
+static struct MHD_Response*
+not_modified_response (const char *etag)
+{
+	struct MHD_Response *response = MHD_create_response_from_buffer (0, "", MHD_RESPMEM_PERSISTENT);
+
+	MHD_add_response_header (response, MHD_HTTP_HEADER_ETAG, etag);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CACHE_CONTROL, CACHE_CONTROL);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+
+	return response;
+}
+
+static struct asset*
+load_asset (const char *url, unsigned int hash)
+{
+	struct asset *asset = calloc(1, sizeof *asset);
+	int i;
+
+	asset->response[ENC_IDENTITY] = load_variant(url, ENC_IDENTITY,
+		asset->etag[ENC_IDENTITY], sizeof asset->etag[ENC_IDENTITY], &asset->size[ENC_IDENTITY]);
+
+	if (asset->response[ENC_IDENTITY] == NULL) {
+		free(asset);
+		return NULL;
+	}
+
+	for (i = 0; i < ENC_COUNT; i++) {
+		if (i != ENC_IDENTITY)
+			asset->response[i] = load_variant(url, i, asset->etag[i], sizeof asset->etag[i], &asset->size[i]);
+		if (asset->response[i])
+			asset->not_modified[i] = not_modified_response(asset->etag[i]);
+	}
+
+	asset->url = strdup(url);
+	asset->hash = hash;
+
+	return asset;
+}
+
+/* whether some variant on disk is no longer the one loaded */
+static int
+changed_since_load (const struct asset *asset)
+{
+	char path[PATH_MAX];
+	char etag[ETAG_SIZE];
+	struct stat st;
+	int i;
+
+	for (i = 0; i < ENC_COUNT; i++) {
+		snprintf(path, sizeof path, "%s%s%s", docroot, asset->url, variant_suffix[i]);
+
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+			if (asset->response[i])
+				return 1;
+			continue;
+		}
+
+		format_etag(etag, sizeof etag, &st, i);
+		if (asset->response[i] == NULL || strcmp(etag, asset->etag[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+free_asset (struct asset *asset)
+{
+	int i;
+
+	/* connections still sending keep their own reference */
+	for (i = 0; i < ENC_COUNT; i++) {
+		if (asset->response[i]) {
+			MHD_destroy_response (asset->response[i]);
+			MHD_destroy_response (asset->not_modified[i]);
+		}
+	}
+
+	free(asset->url);
+	free(asset);
+}
+
+static void
+invalidate (const char *url, size_t len)
+{
+	unsigned int hash = hash_url(url, len);
+	struct asset **p = &buckets[hash % ASSET_BUCKETS];
+
+	while (*p) {
+		struct asset *asset = *p;
+
+		if (asset->hash == hash && strlen(asset->url) == len && !strncmp(asset->url, url, len)) {
+			*p = asset->next;
+			free_asset(asset);
+		} else {
+			p = &asset->next;
+		}
+	}
+}
+
+static void
+invalidate_all (void)
+{
+	int i;
+
+	for (i = 0; i < ASSET_BUCKETS; i++) {
+		while (buckets[i]) {
+			struct asset *asset = buckets[i];
+
+			buckets[i] = asset->next;
+			free_asset(asset);
+		}
+	}
+}
+
+struct MHD_Response*
+asset_response (const char *url, int accepted, const char *if_none_match,
+		int *status, int *cached, size_t *len)
+{
+	static const enum encoding preference[] = { ENC_BR, ENC_GZIP, ENC_IDENTITY };
+
+	unsigned int hash = hash_url(url, strlen(url));
+	struct asset *asset;
+	int i;
+
+	if (!safe_url(url)) {
+		errno = EACCES;
+		return NULL;
+	}
+
+	for (asset = buckets[hash % ASSET_BUCKETS]; asset; asset = asset->next) {
+		if (asset->hash == hash && !strcmp(asset->url, url))
+			break;
+	}
+
+	if (asset == NULL) {
+		int watched = is_watched(url);
+
+		if ((asset = load_asset(url, hash)) == NULL)
+			return NULL;
+
+		/* a write between the load and a new watch went unseen: look again */
+		if (!watched) {
+			watch_dir(url);
+			if (is_watched(url) && changed_since_load(asset)) {
+				free_asset(asset);
+				if ((asset = load_asset(url, hash)) == NULL)
+					return NULL;
+			}
+		}
+
+		/* without a watch we could not tell when to drop it */
+		if (!is_watched(url)) {
+			struct MHD_Response *response = asset->response[ENC_IDENTITY];
+
+			MHD_destroy_response (asset->not_modified[ENC_IDENTITY]);
+			asset->response[ENC_IDENTITY] = NULL;
+
+			*status = MHD_HTTP_OK;
+			*cached = 0;
+			*len = asset->size[ENC_IDENTITY];
+			free_asset(asset);
+			return response;
+		}
+
+		asset->next = buckets[hash % ASSET_BUCKETS];
+		buckets[hash % ASSET_BUCKETS] = asset;
+	}
+
+	*cached = 1;
+
+	for (i = 0; i < sizeof(preference)/sizeof(preference[0]); i++) {
+		enum encoding e = preference[i];
+
+		if (asset->response[e] == NULL || !(accepted & ENC_MASK(e)))
+			continue;
+
+		if (if_none_match && strstr(if_none_match, asset->etag[e])) {
+			*status = MHD_HTTP_NOT_MODIFIED;
+			*len = 0;
+			return asset->not_modified[e];
+		}
+
+		*status = MHD_HTTP_OK;
+		*len = asset->size[e];
+		return asset->response[e];
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+void
+assets_process (void)
+{
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(inotify_fd, buffer, sizeof buffer)) > 0) {
+		char *p;
+
+		for (p = buffer; p < buffer + len; ) {
+			struct inotify_event *event = (struct inotify_event *) p;
+			int i;
+
+			p += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				invalidate_all();
+				continue;
+			}
+
+			for (i = 0; i < nwatches; i++) {
+				char url[PATH_MAX];
+				size_t n;
+				int e;
+
+				if (watches[i].wd != event->wd)
+					continue;
+
+				if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+					/* the directory is gone: forget everything, re-watch on demand */
+					invalidate_all();
+					free(watches[i].dir);
+					watches[i] = watches[--nwatches];
+					break;
+				}
+
+				if (event->len == 0)
+					break;
+
+				n = snprintf(url, sizeof url, "%s%s", watches[i].dir, event->name);
+
+				/* foo.js.gz changing affects what we serve for foo.js */
+				for (e = ENC_COUNT - 1; e > ENC_IDENTITY; e--) {
+					size_t slen = strlen(variant_suffix[e]);
+
+					if (n > slen && !strcmp(url + n - slen, variant_suffix[e])) {
+						n -= slen;
+						break;
+					}
+				}
+
+				invalidate(url, n);
+				break;
+			}
+		}
+	}
+}
+
+int
+assets_fd (void)
+{
+	return inotify_fd;
+}
+
+void
+assets_init (const char *root)
+{
+	docroot = strdup(root);
+
+	/* urls begin with a slash already */
+	if (docroot[0] && docroot[strlen(docroot) - 1] == '/')
+		docroot[strlen(docroot) - 1] = '\0';
+
+	if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		fprintf(stderr, "assets: inotify_init1: %s, caching disabled\n", strerror(errno));
+}
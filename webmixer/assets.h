@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <microhttpd.h>
+
+/* serve static files from docroot */
+extern void assets_init (const char *docroot);
+
+/* inotify descriptor to wait on (-1 when caching is unavailable) */
+extern int assets_fd (void);
+
+/* drain pending inotify events, dropping cached entries that changed */
+extern void assets_process (void);
+
+/*
+ * Response for url, picking a precompressed variant allowed by the
+ * accepted encoding mask. Sets *status (200, or 304 when if_none_match
+ * matches) and *len to the body size. When *cached is set the response
+ * belongs to the cache: queue it, do not destroy it. Returns NULL with
+ * errno set if the file cannot be served.
+ */
+extern struct MHD_Response* asset_response (const char *url, int accepted,
+					    const char *if_none_match,
+					    int *status, int *cached, size_t *len);
+
+#endif
@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Minimal blocking HTTP/1.1 client for the benchmark tools: keep-alive,
+ * Content-Length and chunked bodies, nothing else.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include "httpclient.h"
+
+struct http_connection {
+	int fd;
+	const char *host;
+
+	char *buf;
+	size_t len;
+	size_t size;
+
+	/* bytes of buf belonging to the previous response */
+	size_t consumed;
+};
+
+
+struct http_connection*
+http_connect (const char *host, const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	struct http_connection *c;
+	int fd = -1;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		return NULL;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0)
+		return NULL;
+
+	{
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+	}
+
+	c = calloc(1, sizeof *c);
+	c->fd = fd;
+	c->host = host;
+
+	return c;
+}
+
+void
+http_close (struct http_connection *c)
+{
+	close(c->fd);
+	free(c->buf);
+	free(c);
+}
+
+static int
+write_all (int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* read more bytes into the buffer: >0 read, 0 EOF, <0 error */
+static ssize_t
+read_more (struct http_connection *c)
+{
+	ssize_t n;
+
+	if (c->size - c->len < 4096) {
+		c->size = c->size ? c->size * 2 : 16384;
+		c->buf = realloc(c->buf, c->size + 1);
+	}
+
+	do {
+		n = read(c->fd, c->buf + c->len, c->size - c->len);
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0) {
+		c->len += n;
+		c->buf[c->len] = '\0';
+	}
+
+	return n;
+}
+
+static const char*
+find_header (const char *headers, size_t len, const char *name)
+{
+	size_t name_len = strlen(name);
+	const char *p = headers, *end = headers + len;
+
+	while (p < end) {
+		const char *eol = memmem(p, end - p, "\r\n", 2);
+
+		if (eol == NULL)
+			break;
+
+		if (eol - p > name_len && p[name_len] == ':' && !strncasecmp(p, name, name_len)) {
+			p += name_len + 1;
+			while (*p == ' ') p++;
+			return p;
+		}
+
+		p = eol + 2;
+	}
+
+	return NULL;
+}
+
+/* decode a complete chunked body in place; -1 if incomplete */
+static ssize_t
+dechunk (char *body, size_t len)
+{
+	char *in = body, *out = body, *end = body + len;
+
+	while (in < end) {
+		char *eol = memmem(in, end - in, "\r\n", 2);
+		size_t size;
+
+		if (eol == NULL)
+			return -1;
+
+		size = strtoul(in, NULL, 16);
+		in = eol + 2;
+
+		if (size == 0) {
+			/* trailers end with an empty line */
+			return memmem(in - 2, end - in + 2, "\r\n\r\n", 4) ? out - body : -1;
+		}
+
+		if (in + size + 2 > end)
+			return -1;
+
+		memmove(out, in, size);
+		out += size;
+		in += size + 2;
+	}
+
+	return -1;
+}
+
+static int
+read_response (struct http_connection *c, int head, struct http_response *response)
+{
+	char *header_end;
+	const char *value;
+	size_t header_len;
+	int major, minor;
+
+	while ((header_end = memmem(c->buf ? c->buf : "", c->len, "\r\n\r\n", 4)) == NULL) {
+		if (read_more(c) <= 0)
+			return -1;
+	}
+
+	header_len = header_end - c->buf + 4;
+
+	if (sscanf(c->buf, "HTTP/%d.%d %d", &major, &minor, &response->status) != 3)
+		return -1;
+
+	response->headers = c->buf;
+	response->headers_len = header_len;
+
+	/* HTTP/1.0 closes unless told otherwise, HTTP/1.1 the other way round */
+	value = find_header(c->buf, header_len, "Connection");
+	if (major == 1 && minor == 0)
+		response->keep_alive = value && !strncasecmp(value, "keep-alive", 10);
+	else
+		response->keep_alive = !(value && !strncasecmp(value, "close", 5));
+
+	if (head || response->status == 204 || response->status == 304 || response->status < 200) {
+		response->body_len = 0;
+	} else if ((value = find_header(c->buf, header_len, "Content-Length"))) {
+		size_t length = strtoul(value, NULL, 10);
+
+		while (c->len < header_len + length) {
+			if (read_more(c) <= 0)
+				return -1;
+		}
+		response->body_len = length;
+	} else if ((value = find_header(c->buf, header_len, "Transfer-Encoding")) &&
+		   !strncasecmp(value, "chunked", 7)) {
+		ssize_t length;
+
+		/* decode a copy: the raw bytes may still be incomplete */
+		while (1) {
+			char *copy = malloc(c->len - header_len + 1);
+
+			memcpy(copy, c->buf + header_len, c->len - header_len);
+			length = dechunk(copy, c->len - header_len);
+			if (length >= 0) {
+				memcpy(c->buf + header_len, copy, length);
+				free(copy);
+				break;
+			}
+			free(copy);
+
+			if (read_more(c) <= 0)
+				return -1;
+		}
+
+		/* the whole buffer was this response */
+		response->body_len = length;
+		response->body = c->buf + header_len;
+		c->consumed = c->len;
+		return 0;
+	} else {
+		while (read_more(c) > 0)
+			;
+		response->body_len = c->len - header_len;
+		response->keep_alive = 0;
+	}
+
+	response->body = c->buf + header_len;
+	c->consumed = header_len + response->body_len;
+
+	return 0;
+}
+
+int
+http_request (struct http_connection *c, const char *method, const char *path,
+	      const char *extra_headers, const void *body, size_t body_len,
+	      struct http_response *response)
+{
+	char head[2048];
+	int n;
+
+	/* drop the previous response, keep whatever was pipelined after it */
+	memmove(c->buf, c->buf + c->consumed, c->len - c->consumed);
+	c->len -= c->consumed;
+	c->consumed = 0;
+
+	n = snprintf(head, sizeof head,
+		"%s %s HTTP/1.1\r\n"
+		"Host: %s\r\n"
+		"%s"
+		"Content-Length: %zu\r\n"
+		"\r\n",
+		method, path, c->host, extra_headers ? extra_headers : "", body_len);
+
+	if (n < 0 || n >= sizeof head)
+		return -1;
+
+	if (write_all(c->fd, head, n) < 0 || (body_len && write_all(c->fd, body, body_len) < 0))
+		return -1;
+
+	return read_response(c, !strcmp(method, "HEAD"), response);
+}
+
+int
+http_get (struct http_connection *c, const char *path,
+	  const char *accept, const char *accept_encoding,
+	  struct http_response *response)
+{
+	char headers[512];
+
+	snprintf(headers, sizeof headers, "%s%s%s%s%s%s",
+		accept ? "Accept: " : "", accept ? accept : "", accept ? "\r\n" : "",
+		accept_encoding ? "Accept-Encoding: " : "", accept_encoding ? accept_encoding : "",
+		accept_encoding ? "\r\n" : "");
+
+	return http_request(c, "GET", path, headers, NULL, 0, response);
+}
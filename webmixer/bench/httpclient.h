@@ -0,0 +1,52 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <stddef.h>
+
+struct http_connection;
+
+struct http_response {
+	int status;
+	int keep_alive;
+
+	/* valid until the next request on the same connection */
+	const char *headers;
+	size_t headers_len;
+	const char *body;
+	size_t body_len;
+};
+
+extern struct http_connection* http_connect (const char *host, const char *port);
+extern void http_close (struct http_connection *c);
+
+/* extra_headers: complete "Name: value\r\n" lines, or NULL */
+extern int http_request (struct http_connection *c, const char *method, const char *path,
+			 const char *extra_headers, const void *body, size_t body_len,
+			 struct http_response *response);
+
+extern int http_get (struct http_connection *c, const char *path,
+		     const char *accept, const char *accept_encoding,
+		     struct http_response *response);
+
+#endif
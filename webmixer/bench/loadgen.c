@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Load generator for webmixer.
+ *
+ * Each worker thread keeps one HTTP/1.1 keep-alive connection and issues
+ * GETs back to back, cycling through the given paths, until the duration
+ * elapses. Latencies of every request are kept and reported as
+ * percentiles, together with the throughput and, when the server pid is
+ * known, its peak resident set size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+
+#include "httpclient.h"
+
+#define MAX_PATHS 64
+
+struct worker {
+	pthread_t thread;
+	int id;
+
+	uint32_t *latency_us;
+	size_t count;
+	size_t size;
+
+	size_t errors;
+	uint64_t bytes;
+};
+
+static const char *host = "localhost";
+static const char *port = "8888";
+static const char *accept_header = NULL;
+static const char *accept_encoding = NULL;
+static int concurrency = 4;
+static double duration = 10;
+
+static const char *paths[MAX_PATHS];
+static int npaths;
+
+static volatile int stop;
+
+
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+record (struct worker *w, uint32_t us)
+{
+	if (w->count == w->size) {
+		w->size = w->size ? w->size * 2 : 4096;
+		w->latency_us = realloc(w->latency_us, w->size * sizeof *w->latency_us);
+	}
+
+	w->latency_us[w->count++] = us;
+}
+
+static void*
+work (void *arg)
+{
+	struct worker *w = arg;
+	struct http_connection *c = NULL;
+	int i = w->id;
+
+	while (!stop) {
+		struct http_response response;
+		double start;
+
+		if (c == NULL && (c = http_connect(host, port)) == NULL) {
+			w->errors++;
+			usleep(100000);
+			continue;
+		}
+
+		start = now();
+		if (http_get(c, paths[i++ % npaths], accept_header, accept_encoding, &response) < 0) {
+			w->errors++;
+			http_close(c);
+			c = NULL;
+			continue;
+		}
+
+		record(w, (now() - start) * 1e6);
+		w->bytes += response.body_len;
+		if (response.status >= 500)
+			w->errors++;
+
+		if (!response.keep_alive) {
+			http_close(c);
+			c = NULL;
+		}
+	}
+
+	if (c)
+		http_close(c);
+
+	return NULL;
+}
+
+static int
+compare (const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+percentile (const uint32_t *sorted, size_t n, double p)
+{
+	size_t i;
+
+	if (n == 0)
+		return 0;
+
+	i = p * (n - 1) + 0.5;
+
+	return sorted[i] / 1000.0;
+}
+
+static long
+peak_rss_kb (pid_t pid)
+{
+	char path[64], line[256];
+	long kb = -1;
+	FILE *f;
+
+	snprintf(path, sizeof path, "/proc/%d/status", (int) pid);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+
+	while (fgets(line, sizeof line, f)) {
+		if (!strncmp(line, "VmHWM:", 6)) {
+			kb = strtol(line + 6, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+
+	return kb;
+}
+
+static void
+usage (const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-h host] [-p port] [-c concurrency] [-d seconds]\n"
+		"       [-a accept] [-e accept-encoding] [-s server-pid] path...\n", argv0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	struct worker *workers;
+	uint32_t *all;
+	size_t total = 0, errors = 0;
+	uint64_t bytes = 0;
+	pid_t server = 0;
+	double start, elapsed;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "h:p:c:d:a:e:s:")) != -1) {
+		switch (opt) {
+		case 'h': host = optarg; break;
+		case 'p': port = optarg; break;
+		case 'c': concurrency = atoi(optarg); break;
+		case 'd': duration = atof(optarg); break;
+		case 'a': accept_header = optarg; break;
+		case 'e': accept_encoding = optarg; break;
+		case 's': server = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = optind; i < argc && npaths < MAX_PATHS; i++)
+		paths[npaths++] = argv[i];
+
+	if (npaths == 0 || concurrency < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	workers = calloc(concurrency, sizeof *workers);
+
+	start = now();
+	for (i = 0; i < concurrency; i++) {
+		workers[i].id = i;
+		pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+	}
+
+	while (now() - start < duration)
+		usleep(10000);
+	stop = 1;
+
+	for (i = 0; i < concurrency; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].count;
+	}
+	elapsed = now() - start;
+
+	all = malloc((total ? total : 1) * sizeof *all);
+	total = 0;
+	for (i = 0; i < concurrency; i++) {
+		memcpy(all + total, workers[i].latency_us, workers[i].count * sizeof *all);
+		total += workers[i].count;
+		errors += workers[i].errors;
+		bytes += workers[i].bytes;
+	}
+	qsort(all, total, sizeof *all, compare);
+
+	printf("paths:       ");
+	for (i = 0; i < npaths; i++)
+		printf(" %s", paths[i]);
+	printf("\n");
+	printf("concurrency:  %d\n", concurrency);
+	printf("requests:     %zu (%zu errors)\n", total, errors);
+	printf("throughput:   %.1f req/s, %.1f KiB/s\n", total / elapsed, bytes / elapsed / 1024);
+	printf("latency:      p50 %.3fms  p99 %.3fms  p999 %.3fms  max %.3fms\n",
+		percentile(all, total, 0.5), percentile(all, total, 0.99),
+		percentile(all, total, 0.999), total ? all[total - 1] / 1000.0 : 0);
+	if (server)
+		printf("server rss:   %ld KiB peak\n", peak_rss_kb(server));
+
+	return errors ? 2 : 0;
+}
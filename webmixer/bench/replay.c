@@ -0,0 +1,376 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Replays a trace recorded by webmixer -t against a running webmixer.
+ *
+ * Requests are issued at their recorded offsets, scaled by the speed
+ * factor (-x 2 replays twice as fast, -x 0 as fast as the connections
+ * allow), spread over a pool of keep-alive connections. Latency is
+ * reported per route, along with how far the replay fell behind the
+ * schedule and how many responses differ in status from the recording.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <sys/stat.h>
+
+#include "httpclient.h"
+#include "../trace.h"
+
+struct entry {
+	uint64_t time_us;
+	unsigned int recorded_status;
+	uint32_t recorded_us;
+	char *method;
+	char *route;
+	char *uri;
+	char *headers;
+	const char *body;
+	size_t body_len;
+
+	/* filled by the replay */
+	unsigned int status;
+	uint32_t latency_us;
+	uint32_t late_us;
+	int failed;
+};
+
+static const char *host = "localhost";
+static const char *port = "8888";
+static int connections = 4;
+static double speed = 1;
+
+static struct entry *entries;
+static size_t nentries;
+static size_t next_entry;
+static struct timespec replay_start;
+
+
+static char*
+copy (const char **p, size_t len)
+{
+	char *s = malloc(len + 1);
+
+	memcpy(s, *p, len);
+	s[len] = '\0';
+	*p += len;
+
+	return s;
+}
+
+static int
+load (const char *path, char **data)
+{
+	struct stat st;
+	size_t size, offset, count = 0;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+
+	size = st.st_size;
+	*data = malloc(size ? size : 1);
+	for (offset = 0; offset < size; ) {
+		ssize_t n = read(fd, *data + offset, size - offset);
+
+		if (n <= 0) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+		offset += n;
+	}
+	close(fd);
+
+	if (size < TRACE_MAGIC_SIZE || memcmp(*data, TRACE_MAGIC, TRACE_MAGIC_SIZE)) {
+		fprintf(stderr, "%s: not a webmixer trace\n", path);
+		return -1;
+	}
+
+	/* a trace cut short by a crash ends with a partial record */
+	for (offset = TRACE_MAGIC_SIZE; offset + sizeof(struct trace_record) <= size; ) {
+		struct trace_record record;
+		struct entry *e;
+		const char *p;
+
+		memcpy(&record, *data + offset, sizeof record);
+		if (record.size < sizeof record || offset + record.size > size)
+			break;
+
+		p = *data + offset + sizeof record;
+		offset += record.size;
+
+		/* the client went away before sending its headers */
+		if (record.method_len == 0)
+			continue;
+
+		if (count == nentries) {
+			count = count ? count * 2 : 1024;
+			entries = realloc(entries, count * sizeof *entries);
+		}
+
+		e = &entries[nentries++];
+		memset(e, 0, sizeof *e);
+		e->time_us = record.time_us;
+		e->recorded_status = record.status;
+		e->recorded_us = record.duration_us;
+		e->method = copy(&p, record.method_len);
+		e->route = copy(&p, record.route_len);
+		e->uri = copy(&p, record.uri_len);
+		e->headers = copy(&p, record.headers_len);
+		e->body = p;
+		e->body_len = record.body_len;
+	}
+
+	return 0;
+}
+
+static int
+by_time (const void *a, const void *b)
+{
+	const struct entry *x = a, *y = b;
+
+	return x->time_us < y->time_us ? -1 : x->time_us > y->time_us;
+}
+
+static uint64_t
+elapsed_us (void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - replay_start.tv_sec) * 1000000LL +
+	       (now.tv_nsec - replay_start.tv_nsec) / 1000;
+}
+
+static void
+wait_until (uint64_t due_us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = replay_start.tv_sec + due_us / 1000000;
+	ts.tv_nsec = replay_start.tv_nsec + due_us % 1000000 * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static void*
+work (void *arg)
+{
+	struct http_connection *c = NULL;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&next_entry, 1, __ATOMIC_RELAXED)) < nentries) {
+		struct entry *e = &entries[i];
+		struct http_response response;
+		uint64_t due = 0, sent;
+
+		if (speed > 0) {
+			due = (e->time_us - entries[0].time_us) / speed;
+			wait_until(due);
+		}
+
+		if (c == NULL && (c = http_connect(host, port)) == NULL) {
+			e->failed = 1;
+			continue;
+		}
+
+		sent = elapsed_us();
+		e->late_us = sent > due && speed > 0 ? sent - due : 0;
+
+		if (http_request(c, e->method, e->uri, e->headers, e->body, e->body_len, &response) < 0) {
+			e->failed = 1;
+			http_close(c);
+			c = NULL;
+			continue;
+		}
+
+		e->latency_us = elapsed_us() - sent;
+		e->status = response.status;
+
+		if (!response.keep_alive) {
+			http_close(c);
+			c = NULL;
+		}
+	}
+
+	if (c)
+		http_close(c);
+
+	return NULL;
+}
+
+static int
+by_route_latency (const void *a, const void *b)
+{
+	const struct entry *x = *(const struct entry **) a, *y = *(const struct entry **) b;
+	int r = strcmp(x->route, y->route);
+
+	if (r)
+		return r;
+
+	return x->latency_us < y->latency_us ? -1 : x->latency_us > y->latency_us;
+}
+
+static double
+percentile (struct entry **sorted, size_t n, double p)
+{
+	return sorted[(size_t) (p * (n - 1) + 0.5)]->latency_us / 1000.0;
+}
+
+static size_t
+report (double wall)
+{
+	struct entry **sorted = malloc(nentries * sizeof *sorted);
+	size_t i, j, k, failed = 0, differ = 0;
+	uint32_t late = 0;
+
+	for (i = 0; i < nentries; i++)
+		sorted[i] = &entries[i];
+	qsort(sorted, nentries, sizeof *sorted, by_route_latency);
+
+	printf("%-20s %8s %7s %7s %9s %9s %9s %9s\n",
+		"route", "requests", "failed", "differ", "p50 ms", "p99 ms", "max ms", "was avg");
+
+	for (i = 0; i < nentries; i = j) {
+		size_t route_failed = 0, route_differ = 0;
+		uint64_t recorded = 0;
+		struct entry **ok;
+		size_t nok = 0;
+
+		for (j = i; j < nentries && !strcmp(sorted[j]->route, sorted[i]->route); j++)
+			;
+
+		/* failures have no latency; keep them out of the percentiles */
+		ok = malloc((j - i) * sizeof *ok);
+		for (k = i; k < j; k++) {
+			struct entry *e = sorted[k];
+
+			recorded += e->recorded_us;
+			if (e->failed) {
+				route_failed++;
+				continue;
+			}
+			if (e->status != e->recorded_status)
+				route_differ++;
+			if (e->late_us > late)
+				late = e->late_us;
+			ok[nok++] = e;
+		}
+
+		printf("%-20s %8zu %7zu %7zu", *sorted[i]->route ? sorted[i]->route : "(none)",
+			j - i, route_failed, route_differ);
+		if (nok)
+			printf(" %9.3f %9.3f %9.3f", percentile(ok, nok, 0.5),
+				percentile(ok, nok, 0.99), ok[nok - 1]->latency_us / 1000.0);
+		else
+			printf(" %9s %9s %9s", "-", "-", "-");
+		/* server side time when recorded, no network included */
+		printf(" %9.3f\n", recorded / 1000.0 / (j - i));
+
+		failed += route_failed;
+		differ += route_differ;
+		free(ok);
+	}
+
+	printf("\n");
+	printf("requests:     %zu (%zu failed, %zu with a different status)\n", nentries, failed, differ);
+	printf("trace span:   %.3fs\n", (entries[nentries - 1].time_us - entries[0].time_us) / 1e6);
+	printf("replayed in:  %.3fs, %.1f req/s\n", wall, nentries / wall);
+	if (speed > 0)
+		printf("max behind:   %.3fms\n", late / 1000.0);
+
+	free(sorted);
+
+	return failed;
+}
+
+static void
+usage (const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-h host] [-p port] [-c connections] [-x speed|max] trace\n", argv0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	pthread_t *threads;
+	char *data;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "h:p:c:x:")) != -1) {
+		switch (opt) {
+		case 'h': host = optarg; break;
+		case 'p': port = optarg; break;
+		case 'c': connections = atoi(optarg); break;
+		case 'x': speed = strcmp(optarg, "max") ? atof(optarg) : 0; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind + 1 != argc || connections < 1 || speed < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (load(argv[optind], &data) < 0)
+		return 1;
+
+	if (nentries == 0) {
+		fprintf(stderr, "%s: no requests\n", argv[optind]);
+		return 1;
+	}
+
+	/* records are written on completion, replay them in arrival order */
+	qsort(entries, nentries, sizeof *entries, by_time);
+
+	threads = calloc(connections, sizeof *threads);
+
+	clock_gettime(CLOCK_MONOTONIC, &replay_start);
+	for (i = 0; i < connections; i++)
+		pthread_create(&threads[i], NULL, work, NULL);
+	for (i = 0; i < connections; i++)
+		pthread_join(threads[i], NULL);
+
+	return report(elapsed_us() / 1e6) ? 2 : 0;
+}
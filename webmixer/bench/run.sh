@@ -0,0 +1,104 @@
+#!/bin/sh
+# BEGIN COPYRIGHT NOTICE
+# 
+# This file is part of program "I-Trigue 2.1 3300 Digital Control"
+# Copyright 2013-2014  R. Lemos
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+# END COPYRIGHT NOTICE
+
+# Benchmark webmixer against a virtual sound card.
+#
+#   STANDIN=dummy    load the snd-dummy kernel module (needs root)
+#   STANDIN=softvol  add CONTROLS softvol controls on card BENCH_CARD,
+#                    on top of the null PCM, through an alsa-lib config
+#   STANDIN=none     use whatever cards the machine has
+#
+# Then start webmixer, drive /alsa, targeted subpaths and a static file
+# with loadgen, and print latency percentiles, throughput and peak RSS.
+
+set -e
+
+cd "$(dirname "$0")"
+
+STANDIN=${STANDIN:-dummy}
+CONTROLS=${CONTROLS:-64}
+BENCH_CARD=${BENCH_CARD:-0}
+CONCURRENCY=${CONCURRENCY:-8}
+DURATION=${DURATION:-10}
+PORT=8888
+
+WORK=$(mktemp -d)
+trap 'kill $WEBMIXER 2>/dev/null; rm -rf "$WORK"' EXIT
+
+case "$STANDIN" in
+dummy)
+	if ! grep -q snd_dummy /proc/modules; then
+		modprobe snd-dummy || { echo "cannot load snd-dummy (root needed?)" >&2; exit 1; }
+	fi
+	;;
+softvol)
+	# softvol creates its control the first time the PCM is opened
+	for i in $(seq 1 "$CONTROLS"); do
+		cat >> "$WORK/.asoundrc" <<-EOT
+		pcm.bench$i {
+			type softvol
+			slave.pcm "null"
+			control { name "Bench $i Playback Volume"; card $BENCH_CARD }
+		}
+		EOT
+	done
+	for i in $(seq 1 "$CONTROLS"); do
+		head -c 4 /dev/zero | HOME="$WORK" aplay -q -D "bench$i" -t raw -f S16_LE -c 2 -r 48000 2>/dev/null || true
+	done
+	;;
+none)
+	;;
+*)
+	echo "unknown STANDIN=$STANDIN" >&2
+	exit 1
+	;;
+esac
+
+# static assets of typical UI sizes
+mkdir -p "$WORK/www"
+head -c 2048 /dev/urandom | base64 > "$WORK/www/index.html"
+head -c 65536 /dev/urandom | base64 > "$WORK/www/app.js"
+gzip -k "$WORK/www/app.js"
+
+../webmixer -d "$WORK/www" 2> "$WORK/webmixer.log" &
+WEBMIXER=$!
+
+for i in $(seq 1 50); do
+	curl -sf -o /dev/null "http://localhost:$PORT/index.html" && break
+	sleep 0.1
+done
+
+run () {
+	echo "== $1"
+	shift
+	./loadgen -p $PORT -c "$CONCURRENCY" -d "$DURATION" -s $WEBMIXER "$@" || true
+	echo
+}
+
+run "full tree" /alsa
+run "full tree, CBOR, gzip" -a application/cbor -e gzip /alsa
+run "one card" /alsa/cards/0
+run "one element" /alsa/cards/0/mixer/0 /alsa/cards/0/mixer/1 /alsa/cards/0/mixer/2
+run "names and volumes" "/alsa/cards/0/mixer?fields=name,value.volume.perc,value.playback.volume.perc"
+run "card info only" "/alsa/cards?depth=0"
+run "three elements, batched" "/batch?path=/alsa/cards/0/mixer/0&path=/alsa/cards/0/mixer/1&path=/alsa/cards/0/mixer/2"
+run "static file" /index.html
+run "static file, gzip" -e gzip /app.js
@@ -0,0 +1,300 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+
+#include <asoundlib.h>
+
+#include "snapshot.h"
+#include "history.h"
+#include "events.h"
+#include "cards.h"
+
+#define SND_DIR "/dev/snd"
+
+/* udev fixing up permissions after the node appears shows as IN_ATTRIB */
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO | IN_MOVED_FROM)
+
+/* epoll data of the inotify watch; cards go by their number */
+#define WATCH_TAG MAX_CARDS
+
+struct card {
+	int present;
+	/* held open while the card is there, NULL if opening failed */
+	snd_ctl_t *handle;
+	snd_ctl_card_info_t *info;
+};
+
+static struct card registry[MAX_CARDS];
+static int inotify_fd = -1;
+/* the watch and every card's control events, so the loop has one fd */
+static int epoll_fd = -1;
+static uint64_t generation;
+
+
+static void
+changed (void)
+{
+	generation++;
+	snapshot_touch();
+}
+
+static void
+drop (int number)
+{
+	struct card *c = &registry[number];
+
+	if (!c->present)
+		return;
+
+	/* closing the handle takes it out of the epoll set */
+	if (c->handle)
+		snd_ctl_close(c->handle);
+	if (c->info)
+		snd_ctl_card_info_free(c->info);
+
+	memset(c, 0, sizeof *c);
+	changed();
+}
+
+/* value changes go to the history as they happen */
+static void
+watch_events (int number, snd_ctl_t *handle)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.u32 = number };
+	struct pollfd pfd;
+
+	if (epoll_fd < 0 || snd_ctl_poll_descriptors(handle, &pfd, 1) != 1 ||
+	    snd_ctl_subscribe_events(handle, 1) < 0)
+		return;
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pfd.fd, &ev);
+}
+
+/* a card appeared, or its node became accessible: open it if not yet */
+static void
+add (int number)
+{
+	struct card *c = &registry[number];
+	char name[32];
+
+	if (c->present && c->info)
+		return;
+
+	snprintf(name, sizeof name, "hw:%d", number);
+
+	if (c->handle == NULL) {
+		if (snd_ctl_open(&c->handle, name, SND_CTL_NONBLOCK) < 0)
+			c->handle = NULL;
+		else
+			watch_events(number, c->handle);
+	}
+
+	if (c->handle && c->info == NULL) {
+		if (snd_ctl_card_info_malloc(&c->info) < 0 || snd_ctl_card_info(c->handle, c->info) < 0) {
+			if (c->info)
+				snd_ctl_card_info_free(c->info);
+			c->info = NULL;
+		}
+	}
+
+	if (!c->present) {
+		c->present = 1;
+		changed();
+	}
+}
+
+/* what snd_card_next() sees, replacing what the registry thought */
+static void
+scan (void)
+{
+	int seen[MAX_CARDS] = { 0 };
+	int number = -1, i;
+
+	while (snd_card_next(&number) == 0 && number >= 0) {
+		if (number < MAX_CARDS) {
+			seen[number] = 1;
+			add(number);
+		}
+	}
+
+	for (i = 0; i < MAX_CARDS; i++) {
+		if (!seen[i])
+			drop(i);
+	}
+}
+
+void
+cards_init (void)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.u32 = WATCH_TAG };
+
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		fprintf(stderr, "cards: epoll_create1: %m, no change history\n");
+
+	if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0 &&
+	    inotify_add_watch(inotify_fd, SND_DIR, WATCH_MASK) < 0) {
+		fprintf(stderr, "cards: watching %s: %m, scanning on every request\n", SND_DIR);
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+
+	if (epoll_fd >= 0 && inotify_fd >= 0)
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev);
+
+	/* events from here on; the scan covers what was there before */
+	scan();
+}
+
+int
+cards_fd (void)
+{
+	return epoll_fd >= 0 ? epoll_fd : inotify_fd;
+}
+
+static void
+card_events (int number)
+{
+	struct card *c = &registry[number];
+	snd_ctl_event_t *event;
+	int err = 0;
+
+	snd_ctl_event_alloca(&event);
+
+	while (c->handle && (err = snd_ctl_read(c->handle, event)) > 0) {
+		unsigned int mask = snd_ctl_event_elem_get_mask(event);
+
+		if (snd_ctl_event_get_type(event) == SND_CTL_EVENT_ELEM &&
+		    mask != SND_CTL_EVENT_MASK_REMOVE && (mask & SND_CTL_EVENT_MASK_VALUE))
+			history_changed(number, c->handle, snd_ctl_event_elem_get_numid(event));
+	}
+
+	/* -ENODEV before inotify tells: a dead handle would wake epoll forever */
+	if (c->handle && err < 0 && err != -EAGAIN) {
+		drop(number);
+		return;
+	}
+
+	history_settled(number);
+	events_changed(number);
+}
+
+static void
+watch_process (void)
+{
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(inotify_fd, buffer, sizeof buffer)) > 0) {
+		char *p;
+
+		for (p = buffer; p < buffer + len; ) {
+			struct inotify_event *event = (struct inotify_event *) p;
+			int number, n = 0;
+
+			p += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				scan();
+				continue;
+			}
+
+			if (event->len == 0 || sscanf(event->name, "controlC%d%n", &number, &n) != 1 ||
+			    event->name[n] != '\0' || number < 0 || number >= MAX_CARDS)
+				continue;
+
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				drop(number);
+			else
+				add(number);
+		}
+	}
+}
+
+void
+cards_process (void)
+{
+	struct epoll_event events[MAX_CARDS + 1];
+	int i, n;
+
+	if (epoll_fd < 0) {
+		watch_process();
+		return;
+	}
+
+	n = epoll_wait(epoll_fd, events, MAX_CARDS + 1, 0);
+
+	for (i = 0; i < n; i++) {
+		if (events[i].data.u32 == WATCH_TAG)
+			watch_process();
+		else
+			card_events(events[i].data.u32);
+	}
+}
+
+int
+cards_next (int number)
+{
+	if (number < 0 && inotify_fd < 0)
+		scan();
+
+	for (number++; number < MAX_CARDS; number++) {
+		if (registry[number].present)
+			return number;
+	}
+
+	return -1;
+}
+
+const snd_ctl_card_info_t*
+cards_info (int number)
+{
+	if (number < 0 || number >= MAX_CARDS || !registry[number].present)
+		return NULL;
+
+	/* permissions may have been fixed since */
+	if (registry[number].info == NULL)
+		add(number);
+
+	return registry[number].info;
+}
+
+snd_ctl_t*
+cards_handle (int number)
+{
+	if (number < 0 || number >= MAX_CARDS || !registry[number].present)
+		return NULL;
+
+	return registry[number].handle;
+}
+
+uint64_t
+cards_generation (void)
+{
+	return generation;
+}
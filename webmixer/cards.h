@@ -0,0 +1,60 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef CARDS_H
+#define CARDS_H
+
+#include <stdint.h>
+#include <asoundlib.h>
+
+/* SNDRV_CARDS: card numbers fit in CARD_BITS, from 0 to MAX_CARDS - 1 */
+#define CARD_BITS 5
+#define MAX_CARDS (1 << CARD_BITS)
+
+/*
+ * Registry of the sound cards present, kept current by an inotify watch
+ * on /dev/snd: controlC<N> appearing or going is a card plugged or
+ * unplugged. Requests walk the registry instead of probing the cards.
+ * Without the watch every cards_next(-1) scans again, as before.
+ */
+extern void cards_init (void);
+
+/*
+ * Descriptor to select() on, -1 if none: card arrivals and departures,
+ * and the value events of each card's control, which cards_process()
+ * hands to the change history.
+ */
+extern int cards_fd (void);
+extern void cards_process (void);
+
+/* like snd_card_next(): the next card after number, -1 past the last */
+extern int cards_next (int number);
+
+/* card info read when the card appeared, NULL if it could not be opened */
+extern const snd_ctl_card_info_t* cards_info (int number);
+
+/* the control handle kept open for the card, NULL if none */
+extern snd_ctl_t* cards_handle (int number);
+
+/* bumped whenever a card comes or goes */
+extern uint64_t cards_generation (void);
+
+#endif
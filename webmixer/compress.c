@@ -0,0 +1,171 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#include "compress.h"
+
+#define CACHE_SLOTS 16
+#define MIN_COMPRESS 256
+
+const char *encoding_name[ENC_COUNT] = {
+	[ENC_IDENTITY] = "identity",
+	[ENC_GZIP]     = "gzip",
+	[ENC_BR]       = "br",
+};
+
+static struct cache_entry {
+	uint64_t key;
+	uint64_t body_hash;
+	size_t body_len;
+	enum encoding encoding;
+
+	void *data;
+	size_t len;
+}
+cache[CACHE_SLOTS];
+
+
+int
+encoding_accepted (const char *accept_encoding)
+{
+	int mask = ENC_MASK(ENC_IDENTITY);
+
+	if (accept_encoding == NULL)
+		return mask;
+
+	while (*accept_encoding) {
+		const char *end = accept_encoding + strcspn(accept_encoding, ",;");
+		const char *next = end + strcspn(end, ",");
+		const char *q = NULL;
+		size_t len;
+		int i;
+
+		while (*accept_encoding == ' ') accept_encoding++;
+		len = end - accept_encoding;
+		while (len > 0 && accept_encoding[len - 1] == ' ') len--;
+
+		for (; end < next; end++) {
+			if (*end == '=' && end[-1] == 'q') {
+				q = end + 1;
+				break;
+			}
+		}
+
+		for (i = 0; i < ENC_COUNT; i++) {
+			int wildcard = len == 1 && *accept_encoding == '*';
+
+			if (!wildcard && (strlen(encoding_name[i]) != len || strncasecmp(encoding_name[i], accept_encoding, len)))
+				continue;
+
+			if (q && strtod(q, NULL) == 0)
+				mask &= ~ENC_MASK(i);
+			else
+				mask |= ENC_MASK(i);
+		}
+
+		accept_encoding = *next ? next + 1 : next;
+	}
+
+	return mask;
+}
+
+uint64_t
+compress_hash (uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void*
+gzip (const void *body, size_t len, size_t *out_len)
+{
+	z_stream z;
+	void *out;
+	size_t max;
+
+	memset(&z, 0, sizeof z);
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+
+	max = deflateBound(&z, len);
+	out = malloc(max);
+
+	z.next_in = (Bytef *) body;
+	z.avail_in = len;
+	z.next_out = out;
+	z.avail_out = max;
+
+	if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&z);
+		free(out);
+		return NULL;
+	}
+
+	*out_len = z.total_out;
+	deflateEnd(&z);
+
+	return out;
+}
+
+const void*
+compress_cached (const char *key, enum encoding encoding,
+		 const void *body, size_t len, size_t *out_len)
+{
+	uint64_t key_hash = compress_hash(COMPRESS_HASH_INIT, key, strlen(key));
+	uint64_t body_hash;
+	struct cache_entry *e = &cache[(key_hash ^ encoding) % CACHE_SLOTS];
+
+	/* brotli is only served precompressed, see file_handler() */
+	if (encoding != ENC_GZIP || len < MIN_COMPRESS)
+		return NULL;
+
+	body_hash = compress_hash(COMPRESS_HASH_INIT, body, len);
+
+	if (e->data == NULL || e->key != key_hash || e->encoding != encoding ||
+	    e->body_hash != body_hash || e->body_len != len) {
+		free(e->data);
+
+		e->key = key_hash;
+		e->encoding = encoding;
+		e->body_hash = body_hash;
+		e->body_len = len;
+		e->data = gzip(body, len, &e->len);
+
+		if (e->data == NULL)
+			return NULL;
+	}
+
+	*out_len = e->len;
+
+	return e->data;
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum encoding {
+	ENC_IDENTITY,
+	ENC_GZIP,
+	ENC_BR,
+	ENC_COUNT
+};
+
+#define ENC_MASK(e) (1 << (e))
+
+extern const char *encoding_name[ENC_COUNT];
+
+/* bit mask of the encodings an Accept-Encoding header allows */
+extern int encoding_accepted (const char *accept_encoding);
+
+/*
+ * Compressed copy of body, looked up by key (the request path and format,
+ * say) and by the body itself: a poll that yields the same bytes as the
+ * last one reuses the cached result. Returns NULL when encoding is not
+ * supported or not worth it; the result stays valid until the next call.
+ */
+extern const void* compress_cached (const char *key, enum encoding encoding,
+				    const void *body, size_t len, size_t *out_len);
+
+/* FNV-1a of data, from hash on: folds what a key cannot spell out */
+extern uint64_t compress_hash (uint64_t hash, const void *data, size_t len);
+
+#define COMPRESS_HASH_INIT 0xcbf29ce484222325ULL
+
+#endif
@@ -0,0 +1,501 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "error.h"
+#include "snapshot.h"
+#include "history.h"
+#include "cards.h"
+#include "ctl.h"
+
+struct control {
+	snd_ctl_elem_info_t *info;
+	/* enumerated names, read with the info: asking costs an ioctl each */
+	char **items;
+};
+
+struct ctl_card {
+	snd_ctl_t *handle;
+	/* by numid; numids are dense, so this stays about the list's size */
+	struct control *controls;
+	unsigned int max_numid;
+	/* numids in list order */
+	unsigned int *order;
+	unsigned int count;
+	int stale;
+};
+
+static struct ctl_card cards[MAX_CARDS];
+static snd_ctl_elem_value_t *value;
+static int enabled;
+
+
+void
+ctl_enable (void)
+{
+	enabled = 1;
+}
+
+int
+ctl_enabled (void)
+{
+	return enabled;
+}
+
+static void
+free_control (struct control *c)
+{
+	unsigned int i;
+
+	if (c->info == NULL)
+		return;
+
+	if (c->items) {
+		for (i = 0; i < snd_ctl_elem_info_get_items(c->info); i++)
+			free(c->items[i]);
+		free(c->items);
+	}
+
+	snd_ctl_elem_info_free(c->info);
+	c->info = NULL;
+	c->items = NULL;
+}
+
+static void
+free_table (struct ctl_card *card)
+{
+	unsigned int i;
+
+	for (i = 0; card->controls && i <= card->max_numid; i++)
+		free_control(&card->controls[i]);
+
+	free(card->controls);
+	free(card->order);
+	card->controls = NULL;
+	card->order = NULL;
+	card->max_numid = 0;
+	card->count = 0;
+}
+
+static void
+close_card (struct ctl_card *card)
+{
+	free_table(card);
+
+	if (card->handle)
+		snd_ctl_close(card->handle);
+	card->handle = NULL;
+}
+
+static int
+load_control (snd_ctl_t *handle, struct control *c, unsigned int numid)
+{
+	unsigned int i, items;
+	int err;
+
+	free_control(c);
+
+	if ((err = snd_ctl_elem_info_malloc(&c->info)) < 0)
+		return err;
+
+	snd_ctl_elem_info_set_numid(c->info, numid);
+	if ((err = snd_ctl_elem_info(handle, c->info)) < 0) {
+		snd_ctl_elem_info_free(c->info);
+		c->info = NULL;
+		return err;
+	}
+
+	if (snd_ctl_elem_info_get_type(c->info) != SND_CTL_ELEM_TYPE_ENUMERATED)
+		return 0;
+
+	items = snd_ctl_elem_info_get_items(c->info);
+	c->items = calloc(items, sizeof *c->items);
+
+	for (i = 0; i < items; i++) {
+		snd_ctl_elem_info_set_item(c->info, i);
+		if (snd_ctl_elem_info(handle, c->info) < 0)
+			c->items[i] = strdup("");
+		else
+			c->items[i] = strdup(snd_ctl_elem_info_get_item_name(c->info));
+	}
+
+	return 0;
+}
+
+/* the element list, one info (plus items) per element */
+static int
+load_table (struct ctl_card *card)
+{
+	snd_ctl_elem_list_t *list;
+	unsigned int i, count;
+	int err;
+
+	free_table(card);
+
+	if ((err = snd_ctl_elem_list_malloc(&list)) < 0)
+		return err;
+
+	if ((err = snd_ctl_elem_list(card->handle, list)) < 0 ||
+	    (err = snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list))) < 0 ||
+	    (err = snd_ctl_elem_list(card->handle, list)) < 0) {
+		snd_ctl_elem_list_free(list);
+		return err;
+	}
+
+	count = snd_ctl_elem_list_get_used(list);
+	for (i = 0; i < count; i++) {
+		if (snd_ctl_elem_list_get_numid(list, i) > card->max_numid)
+			card->max_numid = snd_ctl_elem_list_get_numid(list, i);
+	}
+
+	card->controls = calloc(card->max_numid + 1, sizeof *card->controls);
+	card->order = calloc(count ? count : 1, sizeof *card->order);
+
+	for (i = 0; i < count; i++) {
+		unsigned int numid = snd_ctl_elem_list_get_numid(list, i);
+
+		if (load_control(card->handle, &card->controls[numid], numid) == 0)
+			card->order[card->count++] = numid;
+	}
+
+	snd_ctl_elem_list_free_space(list);
+	snd_ctl_elem_list_free(list);
+
+	card->stale = 0;
+
+	return 0;
+}
+
+/*
+ * Catch up with the control events queued since the last request: an
+ * element whose info changed is read again, one added or removed means
+ * listing them all again. Value changes need nothing, values are always
+ * read fresh.
+ */
+static int
+handle_events (struct ctl_card *card)
+{
+	snd_ctl_event_t *event;
+	int err;
+
+	snd_ctl_event_alloca(&event);
+
+	while ((err = snd_ctl_read(card->handle, event)) > 0) {
+		unsigned int mask, numid;
+
+		if (snd_ctl_event_get_type(event) != SND_CTL_EVENT_ELEM)
+			continue;
+
+		mask = snd_ctl_event_elem_get_mask(event);
+		numid = snd_ctl_event_elem_get_numid(event);
+
+		if (mask == SND_CTL_EVENT_MASK_REMOVE || (mask & SND_CTL_EVENT_MASK_ADD) ||
+		    numid > card->max_numid)
+			card->stale = 1;
+		else if ((mask & SND_CTL_EVENT_MASK_INFO) && !card->stale)
+			load_control(card->handle, &card->controls[numid], numid);
+	}
+
+	return err == -EAGAIN ? 0 : err;
+}
+
+static struct ctl_card*
+open_card (int number, json_t **err_node)
+{
+	struct ctl_card *card;
+	char name[32];
+	int err;
+
+	if (number < 0 || number >= MAX_CARDS) {
+		*err_node = error_static(ERR_NO_DEVICE);
+		return NULL;
+	}
+
+	card = &cards[number];
+	snprintf(name, sizeof name, "hw:%d", number);
+
+	if (value == NULL && snd_ctl_elem_value_malloc(&value) < 0) {
+		*err_node = error_static(ERR_INTERNAL);
+		return NULL;
+	}
+
+	/* the card went away (or came back as another): start over */
+	if (card->handle && handle_events(card) < 0)
+		close_card(card);
+
+	if (card->handle == NULL) {
+		if ((err = snd_ctl_open(&card->handle, name, SND_CTL_NONBLOCK)) < 0) {
+			card->handle = NULL;
+			*err_node = error(ERR_NO_DEVICE, "control open (%s): %s", name, snd_strerror(err));
+			return NULL;
+		}
+
+		snd_ctl_subscribe_events(card->handle, 1);
+		card->stale = 1;
+	}
+
+	if (card->stale && (err = load_table(card)) < 0) {
+		*err_node = error(ERR_ALSA, "control list (%s): %s", name, snd_strerror(err));
+		close_card(card);
+		return NULL;
+	}
+
+	return card;
+}
+
+static json_t*
+get_value (const struct control *c)
+{
+	snd_ctl_elem_info_t *info = c->info;
+	json_t *values = json_array();
+	unsigned int i, count = snd_ctl_elem_info_get_count(info);
+	unsigned int item;
+
+	for (i = 0; i < count; i++) {
+		json_t *v;
+
+		switch (snd_ctl_elem_info_get_type(info)) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			v = json_boolean(snd_ctl_elem_value_get_boolean(value, i));
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			v = json_integer(snd_ctl_elem_value_get_integer(value, i));
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			v = json_integer(snd_ctl_elem_value_get_integer64(value, i));
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			item = snd_ctl_elem_value_get_enumerated(value, i);
+			v = item < snd_ctl_elem_info_get_items(info) ?
+			    json_string(c->items[item]) : json_integer(item);
+			break;
+		case SND_CTL_ELEM_TYPE_BYTES:
+			v = json_integer(snd_ctl_elem_value_get_byte(value, i));
+			break;
+		default:
+			v = json_null();
+			break;
+		}
+
+		json_array_append_new(values, v);
+	}
+
+	return values;
+}
+
+static json_t*
+get_control (struct ctl_card *card, unsigned int numid, struct select s)
+{
+	const struct control *c = &card->controls[numid];
+	snd_ctl_elem_info_t *info = c->info;
+	snd_ctl_elem_type_t type = snd_ctl_elem_info_get_type(info);
+	json_t *control = json_object();
+	struct select sub;
+	unsigned int i;
+	int err;
+
+	if (select_value(s, "numid"))
+		json_object_set_new(control, "numid", json_integer(numid));
+	if (select_value(s, "iface"))
+		json_object_set_new(control, "iface", json_string(snd_ctl_elem_iface_name(snd_ctl_elem_info_get_interface(info))));
+	if (select_value(s, "name"))
+		json_object_set_new(control, "name", json_string(snd_ctl_elem_info_get_name(info)));
+	if (select_value(s, "index"))
+		json_object_set_new(control, "index", json_integer(snd_ctl_elem_info_get_index(info)));
+	if (select_value(s, "device"))
+		json_object_set_new(control, "device", json_integer(snd_ctl_elem_info_get_device(info)));
+	if (select_value(s, "subdevice"))
+		json_object_set_new(control, "subdevice", json_integer(snd_ctl_elem_info_get_subdevice(info)));
+	if (select_value(s, "type"))
+		json_object_set_new(control, "type", json_string(snd_ctl_elem_type_name(type)));
+	if (select_value(s, "count"))
+		json_object_set_new(control, "count", json_integer(snd_ctl_elem_info_get_count(info)));
+	if (select_value(s, "writable"))
+		json_object_set_new(control, "writable", json_boolean(snd_ctl_elem_info_is_writable(info)));
+	if (snd_ctl_elem_info_is_inactive(info) && select_value(s, "inactive"))
+		json_object_set_new(control, "inactive", json_true());
+
+	if (type == SND_CTL_ELEM_TYPE_INTEGER && select_object(s, "limits", &sub)) {
+		json_t *limits = json_object();
+
+		if (select_value(sub, "min"))
+			json_object_set_new(limits, "min", json_integer(snd_ctl_elem_info_get_min(info)));
+		if (select_value(sub, "max"))
+			json_object_set_new(limits, "max", json_integer(snd_ctl_elem_info_get_max(info)));
+		if (select_value(sub, "step"))
+			json_object_set_new(limits, "step", json_integer(snd_ctl_elem_info_get_step(info)));
+
+		json_object_set_new(control, "limits", limits);
+	} else if (type == SND_CTL_ELEM_TYPE_INTEGER64 && select_object(s, "limits", &sub)) {
+		json_t *limits = json_object();
+
+		if (select_value(sub, "min"))
+			json_object_set_new(limits, "min", json_integer(snd_ctl_elem_info_get_min64(info)));
+		if (select_value(sub, "max"))
+			json_object_set_new(limits, "max", json_integer(snd_ctl_elem_info_get_max64(info)));
+
+		json_object_set_new(control, "limits", limits);
+	}
+
+	if (type == SND_CTL_ELEM_TYPE_ENUMERATED && select_value(s, "alternatives")) {
+		json_t *alternatives = json_array();
+
+		for (i = 0; i < snd_ctl_elem_info_get_items(info); i++)
+			json_array_append_new(alternatives, json_string(c->items[i]));
+
+		json_object_set_new(control, "alternatives", alternatives);
+	}
+
+	if (snd_ctl_elem_info_is_readable(info) && select_value(s, "value")) {
+		snd_ctl_elem_value_clear(value);
+		snd_ctl_elem_value_set_numid(value, numid);
+
+		if ((err = snd_ctl_elem_read(card->handle, value)) < 0)
+			json_object_set_new(control, "value",
+				error(ERR_ALSA, "control read (%u): %s", numid, snd_strerror(err)));
+		else
+			json_object_set_new(control, "value", get_value(c));
+	}
+
+	return control;
+}
+
+json_t*
+ctl_controls (int number, struct select s)
+{
+	struct ctl_card *card;
+	json_t *controls;
+	unsigned int i;
+
+	if ((card = open_card(number, &controls)) == NULL)
+		return controls;
+
+	controls = json_array();
+	for (i = 0; i < card->count; i++) {
+		json_array_append_new(controls, select_index(s, i) ?
+				      get_control(card, card->order[i], s) : json_null());
+	}
+
+	return controls;
+}
+
+static int
+set_value (const struct control *c, unsigned int i, json_t *v)
+{
+	snd_ctl_elem_info_t *info = c->info;
+	unsigned int item;
+
+	switch (snd_ctl_elem_info_get_type(info)) {
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		if (!json_is_boolean(v) && !json_is_integer(v))
+			return -1;
+		snd_ctl_elem_value_set_boolean(value, i, json_is_true(v) || json_integer_value(v));
+		return 0;
+	case SND_CTL_ELEM_TYPE_INTEGER:
+		if (!json_is_integer(v))
+			return -1;
+		snd_ctl_elem_value_set_integer(value, i, json_integer_value(v));
+		return 0;
+	case SND_CTL_ELEM_TYPE_INTEGER64:
+		if (!json_is_integer(v))
+			return -1;
+		snd_ctl_elem_value_set_integer64(value, i, json_integer_value(v));
+		return 0;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		if (json_is_integer(v)) {
+			snd_ctl_elem_value_set_enumerated(value, i, json_integer_value(v));
+			return 0;
+		}
+		for (item = 0; json_is_string(v) && item < snd_ctl_elem_info_get_items(info); item++) {
+			if (!strcmp(c->items[item], json_string_value(v))) {
+				snd_ctl_elem_value_set_enumerated(value, i, item);
+				return 0;
+			}
+		}
+		return -1;
+	case SND_CTL_ELEM_TYPE_BYTES:
+		if (!json_is_integer(v))
+			return -1;
+		snd_ctl_elem_value_set_byte(value, i, json_integer_value(v));
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+json_t*
+ctl_write (int number, json_t *command)
+{
+	struct select all = { NULL, -1 };
+	json_t *numid_node = json_object_get(command, "numid");
+	json_t *values = json_object_get(command, "value");
+	struct ctl_card *card;
+	const struct control *c;
+	json_t *err_node, *v;
+	unsigned int numid;
+	size_t i;
+	int err;
+
+	if (!json_is_integer(numid_node) || !json_is_array(values))
+		return error(ERR_BAD_REQUEST, "Expected { \"numid\": n, \"value\": [ ... ] }");
+
+	if ((card = open_card(number, &err_node)) == NULL)
+		return err_node;
+
+	numid = json_integer_value(numid_node);
+	if (json_integer_value(numid_node) <= 0 || numid > card->max_numid ||
+	    (c = &card->controls[numid])->info == NULL)
+		return error_static(ERR_NOT_FOUND);
+
+	if (!snd_ctl_elem_info_is_writable(c->info))
+		return error(ERR_BAD_REQUEST, "Control %u is read only", numid);
+
+	if (json_array_size(values) > snd_ctl_elem_info_get_count(c->info))
+		return error(ERR_BAD_REQUEST, "Control %u has %u values", numid,
+			     snd_ctl_elem_info_get_count(c->info));
+
+	/* start from what is there, so a partial array leaves the rest be */
+	snd_ctl_elem_value_clear(value);
+	snd_ctl_elem_value_set_numid(value, numid);
+	if (snd_ctl_elem_info_is_readable(c->info) && (err = snd_ctl_elem_read(card->handle, value)) < 0)
+		return error(ERR_ALSA, "control read (%u): %s", numid, snd_strerror(err));
+
+	json_array_foreach(values, i, v) {
+		if (set_value(c, i, v) < 0)
+			return error(ERR_BAD_REQUEST, "Invalid value %zu for control %u", i, numid);
+	}
+
+	if ((err = snd_ctl_elem_write(card->handle, value)) < 0)
+		return error(ERR_ALSA, "control write (%u): %s", numid, snd_strerror(err));
+
+	history_local(number, SOURCE_HTTP);
+	snapshot_touch();
+
+	return get_control(card, numid, all);
+}
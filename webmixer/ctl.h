@@ -0,0 +1,47 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef CTL_H
+#define CTL_H
+
+#include <jansson.h>
+
+#include "select.h"
+
+/*
+ * Control elements straight from the card's control device, below the
+ * simple mixer: alsa.cards[N].controls when enabled with -c. Each card's
+ * element list and info are read once and kept in a table indexed by
+ * numid, refreshed from control events, so reading a value costs one
+ * ioctl. Nodes reuse the mixer's names where they mean the same thing:
+ * "limits", "alternatives", "inactive", "value".
+ */
+
+extern void ctl_enable (void);
+extern int ctl_enabled (void);
+
+/* alsa.cards[card].controls */
+extern json_t* ctl_controls (int card, struct select s);
+
+/* { "numid": 5, "value": [ ... ] }: a shorter array keeps the rest */
+extern json_t* ctl_write (int card, json_t *command);
+
+#endif
@@ -0,0 +1,485 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * A dump is read with stream.c and its facts go into an open addressing
+ * table, strings kept in one buffer per table. Two tables take turns:
+ * the previous dump and the one being read, which then becomes the
+ * previous. Memory follows the size of one dump, however many there are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <jansson.h>
+
+#include "amixer.h"
+#include "stream.h"
+#include "diff.h"
+
+#define CHUNK (64 * 1024)
+#define FLUSH (1024 * 1024)
+#define MAX_PATH 512
+
+struct fact {
+	uint32_t hash;
+	/* offsets into strings; 0 is an empty slot */
+	uint32_t key;
+	uint32_t value;
+};
+
+struct table {
+	struct fact *slots;
+	/* a power of two */
+	size_t size;
+	/* slot of each fact, in the order they were read */
+	uint32_t *order;
+	size_t count;
+
+	char *strings;
+	size_t len;
+	size_t cap;
+};
+
+struct diff {
+	struct table table[2];
+	/* the dump being read */
+	int current;
+	size_t dumps;
+
+	/* the card whose elements come, "card<N>" without an id */
+	char card[64];
+	int cards;
+
+	/* names of the previous dump and the one being read */
+	char before[256];
+	char after[256];
+	const char *file;
+	int in_file;
+
+	int differences;
+	struct text out;
+};
+
+
+static uint32_t
+hash (const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+
+	return h;
+}
+
+static uint32_t
+save (struct table *t, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	uint32_t offset;
+
+	if (t->len + len > t->cap) {
+		t->cap = (t->len + len) * 2;
+		t->strings = realloc(t->strings, t->cap);
+	}
+
+	offset = t->len;
+	memcpy(t->strings + offset, s, len);
+	t->len += len;
+
+	return offset;
+}
+
+static void
+clear (struct table *t)
+{
+	if (t->slots)
+		memset(t->slots, 0, t->size * sizeof *t->slots);
+	t->count = 0;
+	/* offset 0 stays taken, it marks empty slots */
+	t->len = 1;
+}
+
+static struct fact*
+lookup (struct table *t, const char *key, uint32_t h)
+{
+	size_t i;
+
+	if (t->size == 0)
+		return NULL;
+
+	for (i = h & (t->size - 1); t->slots[i].key; i = (i + 1) & (t->size - 1)) {
+		if (t->slots[i].hash == h && !strcmp(t->strings + t->slots[i].key, key))
+			return &t->slots[i];
+	}
+
+	return &t->slots[i];
+}
+
+static void
+grow (struct table *t)
+{
+	struct fact *old = t->slots;
+	size_t i, size = t->size;
+
+	t->size = size ? size * 2 : 1024;
+	t->slots = calloc(t->size, sizeof *t->slots);
+	t->order = realloc(t->order, t->size * sizeof *t->order);
+
+	for (i = 0; i < t->count; i++) {
+		struct fact *f = &old[t->order[i]];
+		size_t j = f->hash & (t->size - 1);
+
+		while (t->slots[j].key)
+			j = (j + 1) & (t->size - 1);
+
+		t->slots[j] = *f;
+		t->order[i] = j;
+	}
+
+	free(old);
+}
+
+static void
+add (struct table *t, const char *key, const char *value)
+{
+	uint32_t h = hash(key);
+	struct fact *f;
+
+	/* kept at most half full */
+	if (2 * (t->count + 1) > t->size)
+		grow(t);
+
+	f = lookup(t, key, h);
+	if (f->key == 0) {
+		f->hash = h;
+		f->key = save(t, key);
+		t->order[t->count++] = f - t->slots;
+	}
+	f->value = save(t, value);
+}
+
+static void
+scalar (char *buf, size_t size, json_t *value)
+{
+	switch (json_typeof(value)) {
+	case JSON_STRING:
+		snprintf(buf, size, "%s", json_string_value(value));
+		break;
+	case JSON_INTEGER:
+		snprintf(buf, size, "%" JSON_INTEGER_FORMAT, json_integer_value(value));
+		break;
+	case JSON_REAL:
+		snprintf(buf, size, "%g", json_real_value(value));
+		break;
+	case JSON_TRUE:
+		snprintf(buf, size, "true");
+		break;
+	case JSON_FALSE:
+		snprintf(buf, size, "false");
+		break;
+	default:
+		snprintf(buf, size, "null");
+		break;
+	}
+}
+
+static int
+compare_strings (const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* a list of scalars is one fact; capabilities in any order are the same */
+static void
+join (struct text *t, json_t *array, int sorted)
+{
+	size_t i, n = json_array_size(array);
+	char **items = calloc(n + 1, sizeof *items);
+	char buf[256];
+	json_t *value;
+
+	json_array_foreach(array, i, value) {
+		scalar(buf, sizeof buf, value);
+		items[i] = strdup(buf);
+	}
+
+	if (sorted)
+		qsort(items, n, sizeof *items, compare_strings);
+
+	for (i = 0; i < n; i++) {
+		text_printf(t, "%s%s", i ? " " : "", items[i]);
+		free(items[i]);
+	}
+
+	free(items);
+}
+
+static int
+scalars (json_t *array)
+{
+	json_t *value;
+	size_t i;
+
+	json_array_foreach(array, i, value) {
+		if (json_is_object(value) || json_is_array(value))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* facts of node, below path (len bytes of it used) */
+static void
+flatten (struct diff *d, char *path, size_t len, const char *name, json_t *node)
+{
+	struct table *t = &d->table[d->current];
+	char value[256];
+
+	if (len < MAX_PATH)
+		len += snprintf(path + len, MAX_PATH - len, "%s%s", path[len - 1] == ' ' ? "" : ".", name);
+	if (len >= MAX_PATH)
+		return;
+
+	if (json_is_object(node)) {
+		const char *key;
+		json_t *member;
+
+		json_object_foreach(node, key, member) {
+			/* in the path already */
+			if (!strcmp(key, "channel"))
+				continue;
+			flatten(d, path, len, key, member);
+		}
+	} else if (json_is_array(node) && scalars(node)) {
+		struct text list = { NULL, 0, 0 };
+
+		join(&list, node, !strcmp(name, "capabilities"));
+		path[len] = '\0';
+		add(t, path, list.len ? list.data : "");
+		free(list.data);
+	} else if (json_is_array(node)) {
+		json_t *element;
+		size_t i;
+
+		/* channels go by name: which is first does not matter */
+		json_array_foreach(node, i, element) {
+			const char *channel = json_string_value(json_object_get(element, "channel"));
+			char index[32];
+
+			if (channel == NULL)
+				snprintf(index, sizeof index, "%zu", i);
+			flatten(d, path, len, channel ? channel : index, element);
+		}
+	} else {
+		scalar(value, sizeof value, node);
+		path[len] = '\0';
+		add(t, path, value);
+	}
+}
+
+static void
+on_card (void *data, json_t *card)
+{
+	struct diff *d = data;
+	const char *id = json_string_value(json_object_get(card, "id"));
+
+	if (id)
+		snprintf(d->card, sizeof d->card, "%s", id);
+	else
+		snprintf(d->card, sizeof d->card, "card%d", d->cards);
+	d->cards++;
+}
+
+static void
+on_selem (void *data, json_t *selem)
+{
+	struct diff *d = data;
+	char path[MAX_PATH];
+	const char *key;
+	json_t *member;
+	size_t len;
+
+	/* "PCH/Master,0 " heads every fact of the element */
+	len = snprintf(path, sizeof path, "%s/%s,%" JSON_INTEGER_FORMAT " ", d->card,
+		       json_string_value(json_object_get(selem, "name")) ?
+		       json_string_value(json_object_get(selem, "name")) : "",
+		       json_integer_value(json_object_get(selem, "index")));
+	if (len >= sizeof path)
+		return;
+
+	json_object_foreach(selem, key, member) {
+		if (strcmp(key, "name") && strcmp(key, "index"))
+			flatten(d, path, len, key, member);
+	}
+}
+
+static void
+header (struct diff *d)
+{
+	text_printf(&d->out, "--- %s\n+++ %s\n", d->before, d->after);
+	d->differences++;
+}
+
+/* the dump just read against the one before */
+static void
+compare (struct diff *d)
+{
+	struct table *before = &d->table[!d->current];
+	struct table *after = &d->table[d->current];
+	int headed = 0;
+	size_t i;
+
+	for (i = 0; i < after->count; i++) {
+		struct fact *f = &after->slots[after->order[i]];
+		const char *key = after->strings + f->key;
+		struct fact *old = lookup(before, key, f->hash);
+
+		if (old && old->key && !strcmp(before->strings + old->value, after->strings + f->value))
+			continue;
+
+		if (!headed++)
+			header(d);
+		if (old && old->key)
+			text_printf(&d->out, "~ %s: %s -> %s\n", key, before->strings + old->value,
+				    after->strings + f->value);
+		else
+			text_printf(&d->out, "+ %s: %s\n", key, after->strings + f->value);
+	}
+
+	for (i = 0; i < before->count; i++) {
+		struct fact *f = &before->slots[before->order[i]];
+		const char *key = before->strings + f->key;
+		struct fact *now = lookup(after, key, f->hash);
+
+		if (now && now->key)
+			continue;
+
+		if (!headed++)
+			header(d);
+		text_printf(&d->out, "- %s: %s\n", key, before->strings + f->value);
+	}
+
+	if (d->out.len >= FLUSH)
+		text_write(&d->out, STDOUT_FILENO);
+}
+
+static void
+on_end (void *data)
+{
+	struct diff *d = data;
+
+	d->in_file++;
+	if (d->in_file == 1)
+		snprintf(d->after, sizeof d->after, "%s", d->file);
+	else
+		snprintf(d->after, sizeof d->after, "%s#%d", d->file, d->in_file);
+
+	if (d->dumps++ > 0)
+		compare(d);
+
+	memcpy(d->before, d->after, sizeof d->before);
+	d->current = !d->current;
+	clear(&d->table[d->current]);
+	d->cards = 0;
+}
+
+static const struct stream_ops diff_ops = { on_card, on_selem, on_end };
+
+static int
+read_file (struct diff *d, const char *file, char *buffer)
+{
+	struct stream *s = stream_new(&diff_ops, d);
+	int fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+	ssize_t n;
+	int ret = 0;
+
+	if (fd < 0) {
+		fprintf(stderr, "decodejson: %s: %s\n", file, strerror(errno));
+		stream_free(s);
+		return -1;
+	}
+
+	d->file = file;
+	d->in_file = 0;
+
+	while (ret == 0 && (n = read(fd, buffer, CHUNK)) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			fprintf(stderr, "decodejson: %s: %s\n", file, strerror(errno));
+			ret = -1;
+		} else if (stream_feed(s, buffer, n) < 0) {
+			ret = -1;
+		}
+	}
+
+	if (ret == 0 && stream_finish(s) < 0)
+		ret = -1;
+	if (stream_error(s)[0])
+		fprintf(stderr, "decodejson: %s: %s\n", file, stream_error(s));
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+	stream_free(s);
+
+	return ret;
+}
+
+int
+diff (int nfiles, char *files[])
+{
+	struct diff d;
+	char *buffer = malloc(CHUNK);
+	int i, ret = 0;
+
+	memset(&d, 0, sizeof d);
+	clear(&d.table[0]);
+	clear(&d.table[1]);
+
+	for (i = 0; i < nfiles && ret == 0; i++) {
+		if (read_file(&d, files[i], buffer) < 0)
+			ret = 2;
+	}
+
+	text_write(&d.out, STDOUT_FILENO);
+
+	if (ret == 0 && d.dumps < 2) {
+		fprintf(stderr, "decodejson: --diff needs two dumps or more\n");
+		ret = 2;
+	}
+
+	for (i = 0; i < 2; i++) {
+		free(d.table[i].slots);
+		free(d.table[i].order);
+		free(d.table[i].strings);
+	}
+	free(d.out.data);
+	free(buffer);
+
+	return ret ? ret : d.differences > 0;
+}
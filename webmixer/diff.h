@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef DIFF_H
+#define DIFF_H
+
+/*
+ * decodejson --diff a.json b.json ...: what changed between consecutive
+ * mixer dumps, by value rather than by text. Every element becomes facts
+ * keyed by card id, element name and index, and channel, e.g.
+ *
+ *	~ PCH/Master,0 value.Front Left.playback.volume.raw: 40 -> 52
+ *
+ * with + and - for facts that came and went. Files may hold any number
+ * of dumps (NDJSON); each is compared with the one before it, and "-" is
+ * stdin. Returns 0 without differences, 1 with, 2 on trouble, as diff.
+ */
+extern int diff (int nfiles, char *files[]);
+
+#endif
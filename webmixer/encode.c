@@ -0,0 +1,380 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Direct encoders for the mixer tree: each one walks the json_t nodes once
+ * and writes into a single growing buffer, no intermediate representation.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include <jansson.h>
+
+#include "encode.h"
+
+#define JSON_PRETTY_FLAGS (JSON_INDENT(2) | JSON_PRESERVE_ORDER | JSON_ESCAPE_SLASH | JSON_ENCODE_ANY)
+#define JSON_COMPACT_FLAGS (JSON_COMPACT | JSON_PRESERVE_ORDER | JSON_ENCODE_ANY)
+
+const char *format_content_type[FMT_COUNT] = {
+	[FMT_JSON_PRETTY] = "application/json",
+	[FMT_JSON]        = "application/json",
+	[FMT_CBOR]        = "application/cbor",
+	[FMT_MSGPACK]     = "application/msgpack",
+};
+
+static const struct media_type {
+	const char *name;
+	enum format format;
+}
+media_types[] = {
+	{ "application/cbor", FMT_CBOR },
+	{ "application/msgpack", FMT_MSGPACK },
+	{ "application/x-msgpack", FMT_MSGPACK },
+	{ "application/json", FMT_JSON },
+};
+
+struct buffer {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+/*
+ * Accept: application/cbor;q=0.9, application/json;q=0.5, * / *
+ *
+ * The best q-value wins, ties go to the first listed. Anything we do not
+ * know (wildcards included) keeps the indented JSON browsers always got.
+ */
+enum format
+format_negotiate (const char *accept)
+{
+	enum format best = FMT_JSON_PRETTY;
+	double best_q = 0;
+
+	if (accept == NULL)
+		return best;
+
+	while (*accept) {
+		const char *end = accept + strcspn(accept, ",;");
+		const char *next;
+		double q = 1;
+		size_t len;
+		int i;
+
+		while (*accept == ' ') accept++;
+		len = end - accept;
+		while (len > 0 && accept[len - 1] == ' ') len--;
+
+		next = end + strcspn(end, ",");
+		for (; end < next; end++) {
+			if (!strncmp(end, ";q=", 3) || !strncmp(end, "; q=", 4)) {
+				q = strtod(strchr(end, '=') + 1, NULL);
+				break;
+			}
+		}
+
+		for (i = 0; i < sizeof(media_types)/sizeof(media_types[0]); i++) {
+			if (strlen(media_types[i].name) == len &&
+			    !strncasecmp(media_types[i].name, accept, len) &&
+			    q > best_q) {
+				best = media_types[i].format;
+				best_q = q;
+			}
+		}
+
+		accept = *next ? next + 1 : next;
+	}
+
+	return best;
+}
+
+static void
+put (struct buffer *b, const void *data, size_t len)
+{
+	if (b->len + len > b->size) {
+		while (b->len + len > b->size)
+			b->size = b->size ? b->size * 2 : 4096;
+		b->data = realloc(b->data, b->size);
+	}
+
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void
+put_byte (struct buffer *b, unsigned char byte)
+{
+	put(b, &byte, 1);
+}
+
+/* big endian, as both CBOR and MessagePack want it */
+static void
+put_be (struct buffer *b, uint64_t value, int bytes)
+{
+	unsigned char be[8];
+	int i;
+
+	for (i = bytes - 1; i >= 0; i--) {
+		be[i] = value & 0xff;
+		value >>= 8;
+	}
+
+	put(b, be, bytes);
+}
+
+static void
+put_double (struct buffer *b, double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof bits);
+	put_be(b, bits, 8);
+}
+
+/*
+ * CBOR (RFC 7049)
+ */
+
+static void
+cbor_head (struct buffer *b, int major, uint64_t value)
+{
+	major <<= 5;
+
+	if (value < 24) {
+		put_byte(b, major | value);
+	} else if (value <= 0xff) {
+		put_byte(b, major | 24);
+		put_be(b, value, 1);
+	} else if (value <= 0xffff) {
+		put_byte(b, major | 25);
+		put_be(b, value, 2);
+	} else if (value <= 0xffffffff) {
+		put_byte(b, major | 26);
+		put_be(b, value, 4);
+	} else {
+		put_byte(b, major | 27);
+		put_be(b, value, 8);
+	}
+}
+
+static void
+cbor_string (struct buffer *b, const char *s, size_t len)
+{
+	cbor_head(b, 3, len);
+	put(b, s, len);
+}
+
+static void
+cbor_encode (struct buffer *b, json_t *node)
+{
+	switch (json_typeof(node)) {
+	case JSON_OBJECT: {
+		const char *key;
+		json_t *value;
+
+		cbor_head(b, 5, json_object_size(node));
+		json_object_foreach(node, key, value) {
+			cbor_string(b, key, strlen(key));
+			cbor_encode(b, value);
+		}
+		break;
+	}
+	case JSON_ARRAY: {
+		size_t i;
+		json_t *value;
+
+		cbor_head(b, 4, json_array_size(node));
+		json_array_foreach(node, i, value)
+			cbor_encode(b, value);
+		break;
+	}
+	case JSON_STRING:
+		cbor_string(b, json_string_value(node), strlen(json_string_value(node)));
+		break;
+	case JSON_INTEGER: {
+		json_int_t value = json_integer_value(node);
+
+		if (value >= 0)
+			cbor_head(b, 0, value);
+		else
+			cbor_head(b, 1, -1 - value);
+		break;
+	}
+	case JSON_REAL:
+		put_byte(b, 0xfb);
+		put_double(b, json_real_value(node));
+		break;
+	case JSON_TRUE:
+		put_byte(b, 0xf5);
+		break;
+	case JSON_FALSE:
+		put_byte(b, 0xf4);
+		break;
+	case JSON_NULL:
+		put_byte(b, 0xf6);
+		break;
+	}
+}
+
+/*
+ * MessagePack
+ */
+
+static void
+msgpack_length (struct buffer *b, size_t len, int fix, size_t fixmax, int tag16, int tag32)
+{
+	if (len <= fixmax) {
+		put_byte(b, fix | len);
+	} else if (len <= 0xffff) {
+		put_byte(b, tag16);
+		put_be(b, len, 2);
+	} else {
+		put_byte(b, tag32);
+		put_be(b, len, 4);
+	}
+}
+
+static void
+msgpack_string (struct buffer *b, const char *s, size_t len)
+{
+	if (len > 31 && len <= 0xff) {
+		put_byte(b, 0xd9);
+		put_be(b, len, 1);
+	} else {
+		msgpack_length(b, len, 0xa0, 31, 0xda, 0xdb);
+	}
+	put(b, s, len);
+}
+
+static void
+msgpack_integer (struct buffer *b, json_int_t value)
+{
+	if (value >= 0) {
+		if (value < 0x80) {
+			put_byte(b, value);
+		} else if (value <= 0xff) {
+			put_byte(b, 0xcc);
+			put_be(b, value, 1);
+		} else if (value <= 0xffff) {
+			put_byte(b, 0xcd);
+			put_be(b, value, 2);
+		} else if (value <= 0xffffffffLL) {
+			put_byte(b, 0xce);
+			put_be(b, value, 4);
+		} else {
+			put_byte(b, 0xcf);
+			put_be(b, value, 8);
+		}
+	} else {
+		if (value >= -32) {
+			put_byte(b, (unsigned char) value);
+		} else if (value >= INT8_MIN) {
+			put_byte(b, 0xd0);
+			put_be(b, (uint64_t) value, 1);
+		} else if (value >= INT16_MIN) {
+			put_byte(b, 0xd1);
+			put_be(b, (uint64_t) value, 2);
+		} else if (value >= INT32_MIN) {
+			put_byte(b, 0xd2);
+			put_be(b, (uint64_t) value, 4);
+		} else {
+			put_byte(b, 0xd3);
+			put_be(b, (uint64_t) value, 8);
+		}
+	}
+}
+
+static void
+msgpack_encode (struct buffer *b, json_t *node)
+{
+	switch (json_typeof(node)) {
+	case JSON_OBJECT: {
+		const char *key;
+		json_t *value;
+
+		msgpack_length(b, json_object_size(node), 0x80, 15, 0xde, 0xdf);
+		json_object_foreach(node, key, value) {
+			msgpack_string(b, key, strlen(key));
+			msgpack_encode(b, value);
+		}
+		break;
+	}
+	case JSON_ARRAY: {
+		size_t i;
+		json_t *value;
+
+		msgpack_length(b, json_array_size(node), 0x90, 15, 0xdc, 0xdd);
+		json_array_foreach(node, i, value)
+			msgpack_encode(b, value);
+		break;
+	}
+	case JSON_STRING:
+		msgpack_string(b, json_string_value(node), strlen(json_string_value(node)));
+		break;
+	case JSON_INTEGER:
+		msgpack_integer(b, json_integer_value(node));
+		break;
+	case JSON_REAL:
+		put_byte(b, 0xcb);
+		put_double(b, json_real_value(node));
+		break;
+	case JSON_TRUE:
+		put_byte(b, 0xc3);
+		break;
+	case JSON_FALSE:
+		put_byte(b, 0xc2);
+		break;
+	case JSON_NULL:
+		put_byte(b, 0xc0);
+		break;
+	}
+}
+
+char*
+encode (json_t *node, enum format format, size_t *len)
+{
+	struct buffer b = { NULL, 0, 0 };
+	char *page;
+
+	switch (format) {
+	case FMT_JSON_PRETTY:
+	case FMT_JSON:
+		page = json_dumps(node, format == FMT_JSON ? JSON_COMPACT_FLAGS : JSON_PRETTY_FLAGS);
+		*len = strlen(page);
+		return page;
+	case FMT_CBOR:
+		cbor_encode(&b, node);
+		break;
+	case FMT_MSGPACK:
+		msgpack_encode(&b, node);
+		break;
+	default:
+		return NULL;
+	}
+
+	*len = b.len;
+
+	return (char *) b.data;
+}
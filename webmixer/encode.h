@@ -0,0 +1,44 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+enum format {
+	FMT_JSON_PRETTY,
+	FMT_JSON,
+	FMT_CBOR,
+	FMT_MSGPACK,
+	FMT_COUNT
+};
+
+extern const char *format_content_type[FMT_COUNT];
+
+/* pick a format from an Accept header (NULL: pretty JSON, for browsers) */
+extern enum format format_negotiate (const char *accept);
+
+/* serialize node; the returned buffer is malloc()ed and *len bytes long */
+extern char* encode (json_t *node, enum format format, size_t *len);
+
+#endif
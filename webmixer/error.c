@@ -20,28 +20,169 @@
  * END COPYRIGHT NOTICE
  ******************************************************************************/
 
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
 #include <execinfo.h>
 
 #include <jansson.h>
+#include <microhttpd.h>
+
+#include "error.h"
 
 #define DEEPEST_BACKTRACE 20
+#define SYMBOL_CACHE_SIZE 256
+
+static const struct error_desc {
+	const char *code;
+	int status;
+	const char *message;
+}
+error_descs[ERR_COUNT] = {
+	[ERR_INTERNAL]      = { "internal", MHD_HTTP_INTERNAL_SERVER_ERROR, "Internal error" },
+	[ERR_BAD_REQUEST]   = { "bad-request", MHD_HTTP_BAD_REQUEST, "Bad request" },
+	[ERR_NOT_FOUND]     = { "not-found", MHD_HTTP_NOT_FOUND, "Not found" },
+	[ERR_METHOD]        = { "method-not-allowed", MHD_HTTP_METHOD_NOT_ALLOWED, "Method not allowed" },
+	[ERR_INVALID_KEY]   = { "invalid-key", MHD_HTTP_NOT_FOUND, "Invalid key" },
+	[ERR_NOT_ARRAY]     = { "not-array", MHD_HTTP_NOT_FOUND, "Not an array" },
+	[ERR_OUT_OF_BOUNDS] = { "out-of-bounds", MHD_HTTP_NOT_FOUND, "Array index out of bounds" },
+	[ERR_ALSA]          = { "alsa", MHD_HTTP_INTERNAL_SERVER_ERROR, "ALSA error" },
+	[ERR_NO_DEVICE]     = { "no-device", MHD_HTTP_SERVICE_UNAVAILABLE, "No such device" },
+	[ERR_OVERLOADED]    = { "overloaded", MHD_HTTP_SERVICE_UNAVAILABLE, "Too busy, retry later" },
+};
+
+static json_t *static_errors[ERR_COUNT];
+
+static int backtrace_rate;
+static time_t backtrace_window;
+static int backtrace_count;
+
+/* direct mapped: a colliding address simply evicts the previous one */
+static struct symbol {
+	void *addr;
+	char *name;
+}
+symbol_cache[SYMBOL_CACHE_SIZE];
 
 
+static json_t*
+new_error (enum error_code code, const char *message)
+{
+	json_t *error = json_object();
+
+	json_object_set_new(error, "message", json_string(message));
+	json_object_set_new(error, "code", json_string(error_descs[code].code));
+	json_object_set_new(error, "status", json_integer(error_descs[code].status));
+
+	return error;
+}
+
 json_t*
-error (const char *fmt,...)
+error_static (enum error_code code)
+{
+	if (static_errors[code] == NULL)
+		static_errors[code] = new_error(code, error_descs[code].message);
+
+	return json_incref(static_errors[code]);
+}
+
+int
+error_status (json_t *node)
+{
+	json_t *status;
+
+	if (!json_is_object(node) || json_object_get(node, "code") == NULL)
+		return MHD_HTTP_OK;
+
+	status = json_object_get(node, "status");
+
+	return json_is_integer(status) ? json_integer_value(status) : MHD_HTTP_OK;
+}
+
+void
+error_set_backtrace_rate (int per_second)
+{
+	backtrace_rate = per_second;
+}
+
+static int
+backtrace_allowed (void)
+{
+	time_t now;
+
+	if (backtrace_rate <= 0)
+		return 0;
+
+	now = time(NULL);
+	if (now != backtrace_window) {
+		backtrace_window = now;
+		backtrace_count = 0;
+	}
+
+	return backtrace_count++ < backtrace_rate;
+}
+
+static const char*
+symbolize (void *addr)
 {
+	struct symbol *s = &symbol_cache[((uintptr_t) addr >> 2) % SYMBOL_CACHE_SIZE];
+	char buffer[256];
+	Dl_info info;
+
+	if (s->name != NULL && s->addr == addr)
+		return s->name;
+
+	if (!dladdr(addr, &info))
+		snprintf(buffer, sizeof buffer, "??");
+	else if (info.dli_sname)
+		snprintf(buffer, sizeof buffer, "%s+%#tx", info.dli_sname, (char *) addr - (char *) info.dli_saddr);
+	else
+		snprintf(buffer, sizeof buffer, "%s(+%#tx)", info.dli_fname, (char *) addr - (char *) info.dli_fbase);
 
+	free(s->name);
+	s->addr = addr;
+	s->name = strdup(buffer);
+
+	return s->name;
+}
+
+static json_t*
+get_backtrace (void)
+{
 	char buffer[4096];
-	char *p;
-	int max;
+	char *p = buffer;
+	size_t max = sizeof buffer;
 
 	void *bt[DEEPEST_BACKTRACE];
 	int backtrace_size;
-	void **backtrace_p = bt;
+	int i;
 
-	char **backtrace_sym;
+	backtrace_size = backtrace(bt, DEEPEST_BACKTRACE);
 
-	json_t *error = json_object();
+	buffer[0] = 0;
+
+	/* skip ourselves and error() */
+	for (i = 2; i < backtrace_size; i++) {
+		int n = snprintf(p, max, "%p: %s\n", bt[i], symbolize(bt[i]));
+
+		if (n < 0 || (size_t) n >= max)
+			break;
+
+		p += n;
+		max -= n;
+	}
+
+	return json_string(buffer);
+}
+
+json_t*
+error (enum error_code code, const char *fmt,...)
+{
+	char buffer[512];
+	json_t *error;
 
 	va_list va;
 
@@ -49,29 +190,10 @@ error (const char *fmt,...)
 	vsnprintf(buffer, sizeof buffer, fmt, va);
 	va_end(va);
 
-	json_object_set_new(error, "message", json_string(buffer));
-
-	backtrace_size = backtrace(bt, sizeof bt);
-	backtrace_sym = backtrace_symbols(backtrace_p, backtrace_size);
+	error = new_error(code, buffer);
 
-	buffer[0] = 0;
-	p = buffer;
-	max = sizeof buffer;
-
-	backtrace_p++;
-	backtrace_sym++;
-	backtrace_size--;
-	
-	while (backtrace_size > 0) {
-		p += snprintf(p, max, "%p: %s\n", *backtrace_p, *backtrace_sym);
-
-		backtrace_p++;
-		backtrace_sym++;
-		backtrace_size--;
-	}
+	if (backtrace_allowed())
+		json_object_set_new(error, "backtrace", get_backtrace());
 
-	json_object_set_new(error, "backtrace", json_string(buffer));
-	
 	return error;
 }
-
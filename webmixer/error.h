@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <jansson.h>
+
+/*
+ * Error codes. Each one maps to an HTTP status and to a preallocated JSON
+ * object, so routine errors (a client probing bad paths, for instance) cost
+ * no formatting and no allocation.
+ */
+enum error_code {
+	ERR_INTERNAL,
+	ERR_BAD_REQUEST,
+	ERR_NOT_FOUND,
+	ERR_METHOD,
+	ERR_INVALID_KEY,
+	ERR_NOT_ARRAY,
+	ERR_OUT_OF_BOUNDS,
+	ERR_ALSA,
+	ERR_NO_DEVICE,
+	ERR_OVERLOADED,
+	ERR_COUNT
+};
+
+/* shared, immutable error object: the caller owns one reference */
+extern json_t* error_static (enum error_code code);
+
+/* formatted error object, with a backtrace if enabled and not rate-limited */
+extern json_t* error (enum error_code code, const char *fmt,...);
+
+/* HTTP status to answer with when node is the requested resource */
+extern int error_status (json_t *node);
+
+/* allow up to per_second backtraces per second (0 disables them) */
+extern void error_set_backtrace_rate (int per_second);
+
+#endif
@@ -0,0 +1,326 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * The last snapshot is kept and patched as elements change, so a new
+ * stream starts from exactly what the deltas after it apply to. Each
+ * stream has a queue of bytes; when empty the connection is suspended
+ * until there is more, rather than MHD polling the reader.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jansson.h>
+
+#include "select.h"
+#include "alsa.h"
+#include "cards.h"
+#include "amixer.h"
+#include "events.h"
+/* a stream further behind than this ends; it reconnects to a snapshot */
+#define MAX_QUEUED (1024 * 1024)
+/* seconds between comment lines, so proxies do not time it out */
+#define KEEPALIVE 15
+/* browsers reconnect after this many ms */
+#define RETRY "retry: 2000\n\n"
+
+struct watcher {
+	struct MHD_Connection *connection;
+	/* bytes to send, sent up to sent */
+	char *data;
+	size_t len;
+	size_t size;
+	size_t sent;
+	int suspended;
+	/* ends once data is out */
+	int closing;
+	struct watcher *next;
+};
+
+static struct watcher *watchers;
+
+/* the cards as last sent, NULL while nobody watches */
+static json_t *cards;
+/* card number of each of cards */
+static int numbers[MAX_CARDS];
+static int ncards;
+static uint64_t generation;
+
+/* card numbers with new values, as a mask */
+static uint32_t dirty;
+static time_t last_sent;
+
+
+static void
+snapshot (void)
+{
+	static const char * const path[] = { "alsa", "cards" };
+	static const size_t path_len[] = { 4, 5 };
+	struct field *selection = select_compile(2, path, path_len, AMIXER_FIELDS, -1);
+	json_t *root = get_alsa(select_root(selection));
+	int number;
+
+	select_free(selection);
+
+	json_decref(cards);
+	cards = json_incref(json_object_get(json_object_get(root, "alsa"), "cards"));
+	json_decref(root);
+
+	/* the order get_cards() went in */
+	ncards = 0;
+	for (number = cards_next(-1); number >= 0 && ncards < MAX_CARDS; number = cards_next(number))
+		numbers[ncards++] = number;
+
+	generation = cards_generation();
+	dirty = 0;
+}
+
+/* "event: name\ndata: {...}\n\n"; malloc()ed, *len bytes */
+static char*
+event (const char *name, json_t *data, size_t *len)
+{
+	struct text t = { NULL, 0, 0 };
+	char *json = json_dumps(data, JSON_COMPACT | JSON_ENCODE_ANY);
+
+	text_printf(&t, "event: %s\ndata: %s\n\n", name, json ? json : "null");
+	free(json);
+
+	*len = t.len;
+
+	return t.data;
+}
+
+static void
+queue (struct watcher *w, const char *data, size_t len)
+{
+	if (w->closing)
+		return;
+
+	if (w->len - w->sent + len > MAX_QUEUED) {
+		w->closing = 1;
+	} else {
+		if (w->len + len > w->size) {
+			w->size = (w->len + len) * 2;
+			w->data = realloc(w->data, w->size);
+		}
+		memcpy(w->data + w->len, data, len);
+		w->len += len;
+	}
+
+	if (w->suspended) {
+		w->suspended = 0;
+		MHD_resume_connection(w->connection);
+	}
+}
+
+static void
+broadcast (const char *name, json_t *data)
+{
+	struct watcher *w;
+	size_t len;
+	char *text = event(name, data, &len);
+
+	for (w = watchers; w; w = w->next)
+		queue(w, text, len);
+
+	free(text);
+	last_sent = time(NULL);
+}
+
+/* the elements of card pos that changed; -1 if it takes a snapshot */
+static int
+diff_card (int pos)
+{
+	struct select all = { NULL, -1 };
+	json_t *card = json_array_get(cards, pos);
+	json_t *old = json_object_get(card, "mixer");
+	json_t *mixer = get_mixer(numbers[pos], all);
+	json_t *selem;
+	size_t i;
+
+	/* elements only come and go with their card: that is a new snapshot */
+	if (!json_is_array(mixer) || !json_is_array(old) ||
+	    json_array_size(mixer) != json_array_size(old)) {
+		json_decref(mixer);
+		return -1;
+	}
+
+	json_array_foreach(mixer, i, selem) {
+		json_t *delta;
+
+		if (json_equal(selem, json_array_get(old, i)))
+			continue;
+
+		delta = json_object();
+		json_object_set_new(delta, "card", json_integer(pos));
+		json_object_set_new(delta, "index", json_integer(i));
+		json_object_set(delta, "selem", selem);
+		broadcast("selem", delta);
+		json_decref(delta);
+	}
+
+	json_object_set_new(card, "mixer", mixer);
+
+	return 0;
+}
+
+void
+events_changed (int card)
+{
+	if (card >= 0 && card < MAX_CARDS)
+		dirty |= 1u << card;
+}
+
+void
+events_process (void)
+{
+	uint32_t changed = dirty;
+	int pos;
+
+	if (watchers == NULL)
+		return;
+
+	dirty = 0;
+
+	if (generation != cards_generation()) {
+		snapshot();
+		broadcast("snapshot", cards);
+		return;
+	}
+
+	for (pos = 0; changed && pos < ncards; pos++) {
+		if (!(changed & 1u << numbers[pos]))
+			continue;
+
+		if (diff_card(pos) < 0) {
+			snapshot();
+			broadcast("snapshot", cards);
+			return;
+		}
+	}
+
+	if (time(NULL) - last_sent >= KEEPALIVE) {
+		struct watcher *w;
+
+		for (w = watchers; w; w = w->next)
+			queue(w, ":\n\n", 3);
+		last_sent = time(NULL);
+	}
+}
+
+void
+events_close (void)
+{
+	struct watcher *w;
+
+	for (w = watchers; w; w = w->next) {
+		w->closing = 1;
+		if (w->suspended) {
+			w->suspended = 0;
+			MHD_resume_connection(w->connection);
+		}
+	}
+}
+
+static ssize_t
+reader (void *cls, uint64_t pos, char *buf, size_t max)
+{
+	struct watcher *w = cls;
+	size_t n = w->len - w->sent;
+
+	if (n > 0) {
+		if (n > max)
+			n = max;
+
+		memcpy(buf, w->data + w->sent, n);
+		w->sent += n;
+		if (w->sent == w->len)
+			w->sent = w->len = 0;
+
+		return n;
+	}
+
+	if (w->closing)
+		return MHD_CONTENT_READER_END_OF_STREAM;
+
+	/* nothing to send: queue() resumes it */
+	w->suspended = 1;
+	MHD_suspend_connection(w->connection);
+
+	return 0;
+}
+
+static void
+release (void *cls)
+{
+	struct watcher *w = cls, **p;
+
+	for (p = &watchers; *p && *p != w; p = &(*p)->next)
+		;
+	if (*p)
+		*p = w->next;
+
+	free(w->data);
+	free(w);
+
+	/* stop enumerating for nobody */
+	if (watchers == NULL) {
+		json_decref(cards);
+		cards = NULL;
+	}
+}
+
+struct MHD_Response*
+events_response (struct MHD_Connection *connection)
+{
+	struct watcher *w = calloc(1, sizeof *w);
+	struct MHD_Response *response;
+	size_t len;
+	char *text;
+
+	response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, 16 * 1024, reader, w, release);
+	if (response == NULL) {
+		free(w);
+		return NULL;
+	}
+
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/event-stream");
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+
+	/* the first one takes the snapshot, the others share it */
+	if (cards == NULL)
+		snapshot();
+
+	w->connection = connection;
+	w->next = watchers;
+	watchers = w;
+	last_sent = time(NULL);
+
+	queue(w, RETRY, strlen(RETRY));
+	text = event("snapshot", cards, &len);
+	queue(w, text, len);
+	free(text);
+
+	return response;
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <microhttpd.h>
+
+/*
+ * /events, server-sent events for live views. A stream starts with a
+ * "snapshot" of the cards, as /alsa/cards?fields=AMIXER_FIELDS has them,
+ * then gets a "selem" event for each mixer element whose JSON changed:
+ *
+ *	{"card":<index in the snapshot>,"index":<index in its mixer>,"selem":{...}}
+ *
+ * A card coming or going sends a new snapshot. Cards are enumerated only
+ * while somebody watches, and once per change however many do.
+ */
+
+/* the events of card (see cards.c) reported new values */
+extern void events_changed (int card);
+
+/* the response starting a stream on connection */
+extern struct MHD_Response* events_response (struct MHD_Connection *connection);
+
+/* send out what changed since the last call; once per loop */
+extern void events_process (void);
+
+/* end every stream, to let a drain finish */
+extern void events_close (void);
+
+#endif
@@ -0,0 +1,437 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Named groups of mixer controls across cards. A write fans out to one
+ * thread per card: each opens its card's mixer and sets its members, so
+ * the slowest card, not the sum of all of them, bounds the request. The
+ * threads only touch their own mixer and result slots; JSON and errors
+ * are built once they have all been joined.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "error.h"
+#include "alsa.h"
+#include "groups.h"
+#include "snapshot.h"
+#include "history.h"
+#include "cards.h"
+
+struct member {
+	int card;
+	char *element;
+	unsigned int index;
+	char *channel;
+	int dir;
+	double scale;
+	double offset;
+};
+
+struct group {
+	char *name;
+	struct member *members;
+	int nmembers;
+};
+
+/* outcome of one member write, filled in by its card's thread */
+struct result {
+	int err;
+	const char *what;
+	double perc;
+};
+
+struct card_job {
+	pthread_t thread;
+	int threaded;
+	int card;
+	const struct group *group;
+	double perc;
+	struct result *results;
+};
+
+static struct group *groups;
+static int ngroups;
+
+
+/* NULL when m could be read from node, else what is wrong with it */
+static const char*
+load_member (struct member *m, json_t *node)
+{
+	json_t *direction = json_object_get(node, "direction");
+	json_t *scale = json_object_get(node, "scale");
+	json_t *offset = json_object_get(node, "offset");
+	json_int_t card;
+
+	if (!json_is_integer(json_object_get(node, "card")) ||
+	    !json_is_string(json_object_get(node, "element")))
+		return "needs a card and an element";
+
+	card = json_integer_value(json_object_get(node, "card"));
+	if (card < 0 || card >= MAX_CARDS)
+		return "has a card number out of range";
+
+	/* playback unless given, but a misspelt one is not taken for it */
+	if (direction == NULL)
+		m->dir = 0;
+	else if (json_is_string(direction) && !strcmp(json_string_value(direction), alsa_direction_names[0]))
+		m->dir = 0;
+	else if (json_is_string(direction) && !strcmp(json_string_value(direction), alsa_direction_names[1]))
+		m->dir = 1;
+	else
+		return "has a direction other than playback or capture";
+
+	m->card = card;
+	m->element = strdup(json_string_value(json_object_get(node, "element")));
+	m->index = json_integer_value(json_object_get(node, "index"));
+	m->channel = json_is_string(json_object_get(node, "channel")) ?
+		     strdup(json_string_value(json_object_get(node, "channel"))) : NULL;
+	m->scale = json_is_number(scale) ? json_number_value(scale) : 1;
+	m->offset = json_is_number(offset) ? json_number_value(offset) : 0;
+
+	return NULL;
+}
+
+int
+groups_load (const char *path)
+{
+	json_error_t error;
+	json_t *config, *list, *node;
+	const char *name;
+	size_t i;
+
+	if ((config = json_load_file(path, 0, &error)) == NULL) {
+		fprintf(stderr, "%s:%d: %s\n", path, error.line, error.text);
+		return -1;
+	}
+
+	if (!json_is_object(config)) {
+		fprintf(stderr, "%s: expected an object of groups\n", path);
+		json_decref(config);
+		return -1;
+	}
+
+	groups = calloc(json_object_size(config), sizeof *groups);
+
+	json_object_foreach(config, name, list) {
+		struct group *g = &groups[ngroups++];
+
+		g->name = strdup(name);
+		g->members = calloc(json_array_size(list), sizeof *g->members);
+
+		if (!json_is_array(list)) {
+			fprintf(stderr, "%s: group %s: expected an array of members\n", path, name);
+			json_decref(config);
+			return -1;
+		}
+
+		json_array_foreach(list, i, node) {
+			const char *wrong = load_member(&g->members[g->nmembers++], node);
+
+			if (wrong) {
+				fprintf(stderr, "%s: group %s: member %zu %s\n", path, name, i, wrong);
+				json_decref(config);
+				return -1;
+			}
+		}
+	}
+
+	json_decref(config);
+
+	return 0;
+}
+
+static const struct group*
+find_group (const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < ngroups; i++) {
+		if (!strncmp(groups[i].name, name, len) && groups[i].name[len] == '\0')
+			return &groups[i];
+	}
+
+	return NULL;
+}
+
+static snd_mixer_elem_t*
+find_elem (snd_mixer_t *mixer, const struct member *m)
+{
+	snd_mixer_selem_id_t *sid;
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, m->element);
+	snd_mixer_selem_id_set_index(sid, m->index);
+
+	return snd_mixer_find_selem(mixer, sid);
+}
+
+static double
+clamp_perc (double perc)
+{
+	return perc < 0 ? 0 : perc > 100 ? 100 : perc;
+}
+
+static void
+set_member (snd_mixer_t *mixer, const struct member *m, double perc, struct result *result)
+{
+	const struct alsa_volume *v = &alsa_volume[m->dir];
+	snd_mixer_elem_t *elem;
+	long min, max, raw;
+	int chn;
+
+	result->perc = clamp_perc(perc * m->scale + m->offset);
+
+	if ((elem = find_elem(mixer, m)) == NULL || !v->has_volume(elem)) {
+		result->what = "no such element with a volume";
+		result->err = -ENOENT;
+		return;
+	}
+
+	if ((chn = alsa_parse_channel(elem, m->dir, m->channel)) == NO_CHANNEL) {
+		result->what = "no such channel";
+		result->err = -ENOENT;
+		return;
+	}
+
+	v->get_range(elem, &min, &max);
+	raw = min + lround(result->perc * (max - min) / 100);
+
+	result->what = "write";
+	if (chn == ALL_CHANNELS)
+		result->err = v->set_all(elem, raw);
+	else
+		result->err = v->set(elem, chn, raw);
+}
+
+static void*
+card_writer (void *arg)
+{
+	struct card_job *job = arg;
+	snd_mixer_t *mixer;
+	const char *stage;
+	char name[32];
+	int i, err;
+
+	snprintf(name, sizeof name, "hw:%d", job->card);
+	err = alsa_mixer_open(name, &mixer, &stage);
+
+	for (i = 0; i < job->group->nmembers; i++) {
+		const struct member *m = &job->group->members[i];
+
+		if (m->card != job->card)
+			continue;
+
+		if (err < 0) {
+			job->results[i].err = err;
+			job->results[i].what = stage;
+			continue;
+		}
+
+		set_member(mixer, m, job->perc, &job->results[i]);
+	}
+
+	if (err == 0)
+		snd_mixer_close(mixer);
+
+	return NULL;
+}
+
+static json_t*
+describe_member (const struct member *m)
+{
+	json_t *node = json_object();
+
+	json_object_set_new(node, "card", json_integer(m->card));
+	json_object_set_new(node, "element", json_string(m->element));
+	json_object_set_new(node, "index", json_integer(m->index));
+	json_object_set_new(node, "channel", m->channel ? json_string(m->channel) : json_null());
+	json_object_set_new(node, "direction", json_string(alsa_direction_names[m->dir]));
+	json_object_set_new(node, "scale", json_real(m->scale));
+	json_object_set_new(node, "offset", json_real(m->offset));
+
+	return node;
+}
+
+/* the group value, read back from its first member */
+static json_t*
+group_value (const struct group *g)
+{
+	const struct member *m = &g->members[0];
+	snd_mixer_elem_t *elem;
+	snd_mixer_t *mixer;
+	json_t *err = NULL, *value = json_null();
+	char name[32];
+	long min, max, raw;
+	int chn;
+
+	if (g->nmembers == 0 || m->scale == 0)
+		return value;
+
+	snprintf(name, sizeof name, "hw:%d", m->card);
+	if ((mixer = alsa_open_mixer(name, &err)) == NULL)
+		return err;
+
+	if ((elem = find_elem(mixer, m)) && alsa_volume[m->dir].has_volume(elem) &&
+	    (chn = alsa_parse_channel(elem, m->dir, m->channel)) != NO_CHANNEL) {
+		const struct alsa_volume *v = &alsa_volume[m->dir];
+
+		v->get_range(elem, &min, &max);
+		v->get(elem, chn == ALL_CHANNELS ? SND_MIXER_SCHN_MONO : chn, &raw);
+
+		if (max > min)
+			value = json_real(clamp_perc(((raw - min) * 100.0 / (max - min) - m->offset) / m->scale));
+	}
+
+	snd_mixer_close(mixer);
+
+	return value;
+}
+
+static json_t*
+describe_group (const struct group *g, struct select s)
+{
+	json_t *node = json_object();
+	int i;
+
+	if (select_value(s, "name"))
+		json_object_set_new(node, "name", json_string(g->name));
+
+	if (select_value(s, "value"))
+		json_object_set_new(node, "value", group_value(g));
+
+	if (select_value(s, "members")) {
+		json_t *members = json_array();
+
+		for (i = 0; i < g->nmembers; i++)
+			json_array_append_new(members, describe_member(&g->members[i]));
+
+		json_object_set_new(node, "members", members);
+	}
+
+	return node;
+}
+
+json_t*
+groups_tree (struct select s)
+{
+	json_t *tree = json_array();
+	int i;
+
+	for (i = 0; i < ngroups; i++)
+		json_array_append_new(tree, select_index(s, i) ? describe_group(&groups[i], s) : json_null());
+
+	return tree;
+}
+
+json_t*
+group_get (const char *name, size_t len)
+{
+	const struct group *g = find_group(name, len);
+	struct select all = { NULL, -1 };
+
+	if (g == NULL)
+		return error_static(ERR_NOT_FOUND);
+
+	return describe_group(g, all);
+}
+
+json_t*
+group_set (const char *name, size_t len, json_t *command)
+{
+	const struct group *g = find_group(name, len);
+	struct card_job jobs[MAX_CARDS];
+	struct result *results;
+	json_t *perc = json_object_get(command, "perc");
+	json_t *reply, *members;
+	int njobs = 0, i, j;
+
+	if (g == NULL)
+		return error_static(ERR_NOT_FOUND);
+
+	if (!json_is_number(perc))
+		return error(ERR_BAD_REQUEST, "Expected { \"perc\": 0-100 }");
+
+	results = calloc(g->nmembers ? g->nmembers : 1, sizeof *results);
+
+	/* one job per distinct card */
+	for (i = 0; i < g->nmembers; i++) {
+		for (j = 0; j < njobs && jobs[j].card != g->members[i].card; j++)
+			;
+		if (j < njobs)
+			continue;
+
+		jobs[njobs].threaded = 0;
+		jobs[njobs].card = g->members[i].card;
+		jobs[njobs].group = g;
+		jobs[njobs].perc = json_number_value(perc);
+		jobs[njobs].results = results;
+		njobs++;
+	}
+
+	/* the last card runs here rather than in a thread of its own */
+	for (j = 0; j < njobs - 1; j++) {
+		jobs[j].threaded = pthread_create(&jobs[j].thread, NULL, card_writer, &jobs[j]) == 0;
+		if (!jobs[j].threaded)
+			card_writer(&jobs[j]);
+	}
+	if (njobs > 0)
+		card_writer(&jobs[njobs - 1]);
+	for (j = 0; j < njobs - 1; j++) {
+		if (jobs[j].threaded)
+			pthread_join(jobs[j].thread, NULL);
+	}
+
+	/* not from the writers: the history belongs to this thread */
+	for (j = 0; j < njobs; j++)
+		history_local(jobs[j].card, SOURCE_HTTP);
+	snapshot_touch();
+
+	reply = json_object();
+	members = json_array();
+	json_object_set_new(reply, "name", json_string(g->name));
+	json_object_set_new(reply, "members", members);
+
+	for (i = 0; i < g->nmembers; i++) {
+		json_t *node = describe_member(&g->members[i]);
+
+		if (results[i].err < 0)
+			json_object_set_new(node, "error", error(ERR_ALSA, "%s: %s",
+					    results[i].what, snd_strerror(results[i].err)));
+		else
+			json_object_set_new(node, "perc", json_real(results[i].perc));
+
+		json_array_append_new(members, node);
+	}
+
+	free(results);
+
+	return reply;
+}
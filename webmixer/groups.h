@@ -0,0 +1,52 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef GROUPS_H
+#define GROUPS_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+#include "select.h"
+
+/*
+ * Groups config, a JSON object of named member lists:
+ *
+ *   { "zones": [ { "card": 0, "element": "Master" },
+ *                { "card": 1, "element": "PCM", "index": 0,
+ *                  "channel": "Front Left", "direction": "playback",
+ *                  "scale": 0.8, "offset": -5 } ] }
+ *
+ * A member set to p percent goes to p * scale + offset. direction is
+ * "playback" or "capture", playback when left out.
+ */
+extern int groups_load (const char *path);
+
+/* alsa.groups in the /alsa tree */
+extern json_t* groups_tree (struct select s);
+
+/* name is not NUL terminated */
+extern json_t* group_get (const char *name, size_t len);
+
+/* { "perc": 40 }: every member written in parallel, one thread per card */
+extern json_t* group_set (const char *name, size_t len, json_t *command);
+
+#endif
@@ -0,0 +1,477 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * The ring lives in an anonymous shared mapping, made before workers are
+ * forked, so every worker answers /history alike. They all see the same
+ * card events; the shared last values make the first one to read a change
+ * the only one to record it, and the source a writer announced is shared
+ * too, whichever worker gets to read its events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "cards.h"
+#include "history.h"
+
+#define HISTORY_SIZE (256 * 1024)
+/* largest encoded change: three 64 bit varints and a byte */
+#define MAX_RECORD 31
+
+/* channels past this are byte arrays and such, not levels */
+#define MAX_CHANNEL 63
+
+/* last value seen per card, numid and channel, to record changes only */
+#define LAST_SLOTS 4096
+
+/* answers stop here, with "more": true */
+#define MAX_ANSWER 10000
+
+struct change {
+	uint64_t time;
+	int card;
+	unsigned int numid;
+	int channel;
+	enum history_source source;
+	int64_t value;
+};
+
+struct log {
+	unsigned char ring[HISTORY_SIZE];
+	/* oldest byte, next byte to write, bytes in use */
+	size_t tail, head, used;
+	/* times of the oldest and the newest change, unix ms */
+	uint64_t tail_time, head_time;
+};
+
+struct last {
+	uint32_t key;
+	int used;
+	int64_t value;
+};
+
+struct shared {
+	pthread_mutex_t lock;
+	struct log log;
+	struct last last[LAST_SLOTS];
+	/* where the changes a card reports next come from, and who said so */
+	enum history_source pending[MAX_CARDS];
+	pid_t pending_pid[MAX_CARDS];
+};
+
+static struct shared *shared;
+
+static const char *source_names[] = {
+	[SOURCE_OTHER] = "other",
+	[SOURCE_HTTP] = "http",
+	[SOURCE_RAMP] = "ramp",
+};
+
+
+static uint64_t
+now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static size_t
+put_varint (unsigned char *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+
+	return n;
+}
+
+/* from the ring at *pos, wrapping */
+static uint64_t
+get_varint (const struct log *log, size_t *pos)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	unsigned char b;
+
+	do {
+		b = log->ring[*pos];
+		*pos = (*pos + 1) % HISTORY_SIZE;
+		v |= (uint64_t) (b & 0x7f) << shift;
+		shift += 7;
+	} while ((b & 0x80) && shift < 64);
+
+	return v;
+}
+
+static size_t
+encode_change (unsigned char *p, uint64_t delta, const struct change *c)
+{
+	size_t n = 0;
+
+	n += put_varint(p + n, delta);
+	n += put_varint(p + n, (uint64_t) c->numid << CARD_BITS | c->card);
+	p[n++] = c->source << 6 | c->channel;
+	n += put_varint(p + n, ((uint64_t) c->value << 1) ^ (uint64_t) (c->value >> 63));
+
+	return n;
+}
+
+/* the change at *pos, its time advanced from *time by its delta */
+static void
+decode_change (const struct log *log, size_t *pos, uint64_t *time, struct change *c)
+{
+	uint64_t id, zigzag;
+	unsigned char b;
+
+	*time += get_varint(log, pos);
+	id = get_varint(log, pos);
+	b = log->ring[*pos];
+	*pos = (*pos + 1) % HISTORY_SIZE;
+	zigzag = get_varint(log, pos);
+
+	c->time = *time;
+	c->card = id & (MAX_CARDS - 1);
+	c->numid = id >> CARD_BITS;
+	c->source = b >> 6;
+	c->channel = b & 63;
+	c->value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+}
+
+static void
+drop_oldest (struct log *log)
+{
+	struct change c;
+	size_t pos = log->tail;
+	uint64_t time = 0;
+
+	decode_change(log, &pos, &time, &c);
+	log->used -= (pos + HISTORY_SIZE - log->tail) % HISTORY_SIZE;
+	log->tail = pos;
+
+	/* the next one's delta was from the one just dropped */
+	if (log->used > 0) {
+		pos = log->tail;
+		log->tail_time += get_varint(log, &pos);
+	}
+}
+
+static void
+record (struct log *log, struct change *c)
+{
+	unsigned char buffer[MAX_RECORD];
+	size_t i, n;
+
+	/* the clock going back would make a negative delta */
+	if (c->time < log->head_time)
+		c->time = log->head_time;
+
+	n = encode_change(buffer, log->used ? c->time - log->head_time : 0, c);
+
+	while (log->used + n > HISTORY_SIZE)
+		drop_oldest(log);
+
+	if (log->used == 0)
+		log->tail_time = c->time;
+
+	for (i = 0; i < n; i++)
+		log->ring[(log->head + i) % HISTORY_SIZE] = buffer[i];
+
+	log->head = (log->head + n) % HISTORY_SIZE;
+	log->used += n;
+	log->head_time = c->time;
+}
+
+/* 1 if key had another value, or none; remembers value either way */
+static int
+differs (uint32_t key, int64_t value)
+{
+	struct last *last = shared->last;
+	size_t slot = (key * 2654435761U) % LAST_SLOTS;
+	size_t i;
+
+	for (i = 0; i < LAST_SLOTS; i++) {
+		struct last *l = &last[(slot + i) % LAST_SLOTS];
+
+		if (l->used && l->key != key)
+			continue;
+
+		if (l->used && l->value == value)
+			return 0;
+
+		l->key = key;
+		l->used = 1;
+		l->value = value;
+		return 1;
+	}
+
+	/* full: take over the home slot */
+	last[slot].key = key;
+	last[slot].value = value;
+
+	return 1;
+}
+
+int
+history_init (void)
+{
+	pthread_mutexattr_t attr;
+	void *p = mmap(NULL, sizeof *shared, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		perror("history");
+		return -1;
+	}
+
+	/* the mapping comes zeroed: nothing recorded, nothing pending */
+	shared = p;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&shared->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return 0;
+}
+
+static void
+lock (void)
+{
+	/* a worker died recording: start over rather than decode a torn ring */
+	if (pthread_mutex_lock(&shared->lock) == EOWNERDEAD) {
+		memset(&shared->log, 0, sizeof shared->log);
+		pthread_mutex_consistent(&shared->lock);
+	}
+}
+
+static void
+unlock (void)
+{
+	pthread_mutex_unlock(&shared->lock);
+}
+
+void
+history_local (int card, enum history_source source)
+{
+	if (shared == NULL || card < 0 || card >= MAX_CARDS)
+		return;
+
+	__atomic_store_n(&shared->pending_pid[card], getpid(), __ATOMIC_RELAXED);
+	__atomic_store_n(&shared->pending[card], source, __ATOMIC_RELEASE);
+}
+
+void
+history_settled (int card)
+{
+	if (shared == NULL || card < 0 || card >= MAX_CARDS)
+		return;
+
+	/* only once the writer has read its own events back */
+	if (__atomic_load_n(&shared->pending_pid[card], __ATOMIC_RELAXED) != getpid())
+		return;
+
+	__atomic_store_n(&shared->pending[card], SOURCE_OTHER, __ATOMIC_RELEASE);
+	__atomic_store_n(&shared->pending_pid[card], 0, __ATOMIC_RELAXED);
+}
+
+void
+history_changed (int card, snd_ctl_t *handle, unsigned int numid)
+{
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_value_t *value;
+	struct change c;
+	unsigned int i, count;
+
+	if (shared == NULL || card < 0 || card >= MAX_CARDS)
+		return;
+
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&value);
+
+	snd_ctl_elem_info_set_numid(info, numid);
+	snd_ctl_elem_value_set_numid(value, numid);
+
+	if (snd_ctl_elem_info(handle, info) < 0 || !snd_ctl_elem_info_is_readable(info) ||
+	    snd_ctl_elem_read(handle, value) < 0)
+		return;
+
+	c.time = now_ms();
+	c.card = card;
+	c.numid = numid;
+	c.source = __atomic_load_n(&shared->pending[card], __ATOMIC_ACQUIRE);
+
+	count = snd_ctl_elem_info_get_count(info);
+
+	lock();
+	for (i = 0; i < count && i <= MAX_CHANNEL; i++) {
+		switch (snd_ctl_elem_info_get_type(info)) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			c.value = snd_ctl_elem_value_get_boolean(value, i);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			c.value = snd_ctl_elem_value_get_integer(value, i);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			c.value = snd_ctl_elem_value_get_integer64(value, i);
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			c.value = snd_ctl_elem_value_get_enumerated(value, i);
+			break;
+		default:
+			unlock();
+			return;
+		}
+
+		c.channel = i;
+		if (differs(card << 24 | (numid & 0x3ffff) << 6 | i, c.value))
+			record(&shared->log, &c);
+	}
+	unlock();
+}
+
+#define NAME_CACHE 64
+
+/*
+ * Name and index of a control, looked up at query time: after a replug
+ * the numids of old changes may name other controls. Empty name when the
+ * card or the control is gone.
+ */
+struct name_cache {
+	int filled;
+	int card;
+	unsigned int numid;
+	char name[64];
+	unsigned int index;
+};
+
+static void
+control_name (struct name_cache *n, int card, unsigned int numid)
+{
+	snd_ctl_t *handle = cards_handle(card);
+	snd_ctl_elem_info_t *info;
+
+	n->filled = 1;
+	n->card = card;
+	n->numid = numid;
+	n->name[0] = '\0';
+	n->index = 0;
+
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_info_set_numid(info, numid);
+
+	if (handle && snd_ctl_elem_info(handle, info) == 0) {
+		snprintf(n->name, sizeof n->name, "%s", snd_ctl_elem_info_get_name(info));
+		n->index = snd_ctl_elem_info_get_index(info);
+	}
+}
+
+json_t*
+history_query (uint64_t since, uint64_t until, int card, const char *control)
+{
+	json_t *answer = json_object();
+	json_t *changes = json_array();
+	struct name_cache *cache = calloc(NAME_CACHE, sizeof *cache);
+	struct log *log = malloc(sizeof *log);
+	size_t pos, seen = 0;
+	uint64_t time = 0;
+
+	/* decoded from a copy: recording goes on meanwhile */
+	if (shared) {
+		lock();
+		memcpy(log, &shared->log, sizeof *log);
+		unlock();
+	} else {
+		memset(log, 0, sizeof *log);
+	}
+	pos = log->tail;
+
+	json_object_set_new(answer, "changes", changes);
+	json_object_set_new(answer, "oldest", log->used ? json_integer(log->tail_time) : json_null());
+
+	while (seen < log->used) {
+		size_t start = pos;
+		struct name_cache *n;
+		struct change c;
+		json_t *node;
+
+		decode_change(log, &pos, &time, &c);
+		seen += (pos + HISTORY_SIZE - start) % HISTORY_SIZE;
+
+		/* the oldest one's delta was from a change long dropped */
+		if (start == log->tail)
+			c.time = time = log->tail_time;
+
+		if (c.time < since)
+			continue;
+		if (c.time > until)
+			break;
+
+		if (card >= 0 && c.card != card)
+			continue;
+
+		n = &cache[(c.numid * MAX_CARDS + c.card) % NAME_CACHE];
+		if (!n->filled || n->card != c.card || n->numid != c.numid)
+			control_name(n, c.card, c.numid);
+
+		if (control && strcmp(n->name, control))
+			continue;
+
+		if (json_array_size(changes) == MAX_ANSWER) {
+			json_object_set_new(answer, "more", json_true());
+			break;
+		}
+
+		node = json_object();
+		json_object_set_new(node, "time", json_integer(c.time));
+		json_object_set_new(node, "card", json_integer(c.card));
+		json_object_set_new(node, "numid", json_integer(c.numid));
+		json_object_set_new(node, "control", n->name[0] ? json_string(n->name) : json_null());
+		json_object_set_new(node, "index", json_integer(n->index));
+		json_object_set_new(node, "channel", json_integer(c.channel));
+		json_object_set_new(node, "value", json_integer(c.value));
+		json_object_set_new(node, "source", json_string(source_names[c.source]));
+		json_array_append_new(changes, node);
+	}
+
+	free(cache);
+	free(log);
+
+	return answer;
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <asoundlib.h>
+#include <jansson.h>
+
+/*
+ * Every control value change seen on the cards, kept in a fixed ring of
+ * HISTORY_SIZE bytes, oldest dropped first. A change is a few bytes:
+ * varints for the time since the previous change and for card and numid,
+ * a byte for channel and source, a zigzag varint for the value.
+ */
+
+enum history_source {
+	/* another program, alsamixer say */
+	SOURCE_OTHER,
+	/* a request: a group or control write */
+	SOURCE_HTTP,
+	SOURCE_RAMP,
+};
+
+/* map the shared ring; call before forking, the workers inherit it */
+extern int history_init (void);
+
+/* we wrote to card; the changes it reports next, until settled, are ours */
+extern void history_local (int card, enum history_source source);
+
+/* a value event on numid: record what changed since last seen */
+extern void history_changed (int card, snd_ctl_t *handle, unsigned int numid);
+
+/* the events read so far for card are accounted for, if we wrote it */
+extern void history_settled (int card);
+
+/*
+ * Changes between since and until (unix ms), on card unless -1 and on the
+ * controls named control, when given. Controls are named as the card's
+ * control device does, "Master Playback Volume" say, and go by numid as
+ * in alsa.cards[N].controls.
+ */
+extern json_t* history_query (uint64_t since, uint64_t until, int card, const char *control);
+
+#endif
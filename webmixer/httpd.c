@@ -20,51 +20,174 @@
  * END COPYRIGHT NOTICE
  ******************************************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <jansson.h>
 #include <microhttpd.h>
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
-#include <arpa/inet.h>
 
-extern json_t* get_alsa(void);
-extern json_t* error (const char *fmt,...);
+#include "error.h"
+#include "encode.h"
+#include "compress.h"
+#include "assets.h"
+#include "router.h"
+#include "accesslog.h"
+#include "metrics.h"
+#include "trace.h"
+#include "select.h"
+#include "alsa.h"
+#include "ramp.h"
+#include "groups.h"
+#include "snapshot.h"
+#include "httpd.h"
+#include "admission.h"
+#include "ctl.h"
+#include "cards.h"
+#include "state.h"
+#include "history.h"
+#include "probes.h"
+#include "amixer.h"
+#include "events.h"
 
 static int
-file_handler (void *cls, struct MHD_Connection *connection,
-	      const char *url,
-	      const char *method, const char *version,
-	      const char *upload_data,
-	      size_t *upload_data_size, void **con_cls)
+accepted_encodings (struct MHD_Connection *connection)
 {
-	int fd;
-	struct stat file_stat;
+	return encoding_accepted(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING));
+}
 
-	struct MHD_Response *response;
+/* queue response, accounting for it in the access log */
+static int
+queue_response (struct request *req, unsigned int status,
+		struct MHD_Response *response, size_t len)
+{
+	req->status = status;
+	req->bytes = len;
+
+	if (req->stale)
+		MHD_add_response_header (response, "Warning", "110 - \"Response is Stale\"");
+
+	/* RFC 9110: a 405 says what the resource does take */
+	if (status == MHD_HTTP_METHOD_NOT_ALLOWED && req->allow[0])
+		MHD_add_response_header (response, MHD_HTTP_HEADER_ALLOW, req->allow);
+
+	return MHD_queue_response (req->connection, status, response);
+}
+
+/*
+ * Queue node encoded as format. When cache_key is given the body may be
+ * sent gzipped; compress_cached() keeps the compressed bytes around so a
+ * repeated poll of unchanged state does not compress again.
+ */
+static int
+queue_node (struct request *req, json_t *node, enum format format,
+	    const char *cache_key)
+{
+	struct MHD_Connection *connection = req->connection;
+	char *page;
+	size_t len;
+	struct MHD_Response *response = NULL;
+	struct timespec start;
 	int ret;
 
-	if ((fd = open(url + 1, O_RDONLY)) < 0) {
-		fprintf(stderr, "Error opening file %s: %s\n", url + 1, strerror(errno));
-		return MHD_NO;
+	PROBE1(encode__start, req);
+	metrics_start(&start);
+	page = encode(node, format, &len);
+	metrics_time(TIMER_ENCODE, &start);
+	PROBE2(encode__done, req, len);
+
+	if (cache_key && (accepted_encodings(connection) & ENC_MASK(ENC_GZIP))) {
+		char key[512];
+		const void *compressed;
+		size_t compressed_len;
+
+		snprintf(key, sizeof key, "%d:%s", format, cache_key);
+
+		if ((compressed = compress_cached(key, ENC_GZIP, page, len, &compressed_len))) {
+			response = MHD_create_response_from_buffer (compressed_len, (void*) compressed, MHD_RESPMEM_MUST_COPY);
+			MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_ENCODING, encoding_name[ENC_GZIP]);
+			free(page);
+			len = compressed_len;
+		}
 	}
-	
-	fstat(fd, &file_stat);
 
-	response = MHD_create_response_from_fd (file_stat.st_size, fd);
+	if (response == NULL)
+		response = MHD_create_response_from_buffer (len, (void*) page, MHD_RESPMEM_MUST_FREE);
+
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, format_content_type[format]);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_VARY, "Accept, Accept-Encoding");
+
+	ret = queue_response (req, error_status(node), response, len);
+	MHD_destroy_response (response);
+
+	return ret;
+}
+
+/* shed by admission control: the client is to come back in retry_after seconds */
+static int
+queue_overloaded (struct request *req, unsigned int retry_after)
+{
+	json_t *node = error_static(ERR_OVERLOADED);
+	struct MHD_Response *response;
+	char seconds[16];
+	char *page;
+	size_t len;
+	int ret;
+
+	page = encode(node, FMT_JSON, &len);
+	json_decref(node);
+
+	snprintf(seconds, sizeof seconds, "%u", retry_after);
 
-	ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+	response = MHD_create_response_from_buffer (len, (void*) page, MHD_RESPMEM_MUST_FREE);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, format_content_type[FMT_JSON]);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_RETRY_AFTER, seconds);
+
+	ret = queue_response (req, MHD_HTTP_SERVICE_UNAVAILABLE, response, len);
 	MHD_destroy_response (response);
 
 	return ret;
 }
 
+static int
+file_handler (struct request *req)
+{
+	struct MHD_Response *response;
+	int status, cached;
+	size_t len;
+	int ret;
+
+	response = asset_response(req->url, accepted_encodings(req->connection),
+		MHD_lookup_connection_value(req->connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH),
+		&status, &cached, &len);
+
+	if (response == NULL) {
+		json_t *node = error_static(errno == ENOENT || errno == ENOTDIR || errno == EACCES ? ERR_NOT_FOUND : ERR_INTERNAL);
+
+		ret = queue_node(req, node, FMT_JSON, NULL);
+		json_decref(node);
+
+		return ret;
+	}
+
+	ret = queue_response (req, status, response, len);
+	if (!cached)
+		MHD_destroy_response (response);
+
+	return ret;
+}
+
 static void
 assign_and_prune (json_t **lvalue, json_t *rvalue)
 {
@@ -74,102 +197,613 @@ assign_and_prune (json_t **lvalue, json_t *rvalue)
 	*lvalue = rvalue;
 }
 
+static int
+is_index (const char *segment, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!isdigit(segment[i]))
+			return 0;
+	}
+
+	return len > 0;
+}
+
+/* descend node along path segments; takes over the reference to node */
 static json_t*
-json_walk (json_t *node, const char *url)
+json_walk (json_t *node, int nsegments, const char * const *segments,
+	   const size_t *segment_len)
 {
-	while (url[0] == '/' && url[1] != '\0') {
-		const char * const backup = url;
+	int i;
 
-		url++;
+	for (i = 0; i < nsegments; i++) {
+		const char *segment = segments[i];
+		size_t len = segment_len[i];
 
-		if (isdigit(*url)) {
-			int size;
-			int idx = 0;
+		if (is_index(segment, len)) {
+			size_t size;
+			size_t idx = 0;
 
 			if (!json_is_array(node)) {
 				assign_and_prune(&node,
-					error("Not an array (at %s)", backup));
+					error_static(ERR_NOT_ARRAY));
 				json_decref(node);
 				return node;
 			}
 
 			size = json_array_size(node);
 
-			while (isdigit(*url)) idx = idx * 10 + (*url++ - '0');
+			while (len-- > 0 && idx < size) idx = idx * 10 + (*segment++ - '0');
 
-			if (idx < 0 || idx >= size) {
+			if (idx >= size) {
 				assign_and_prune(&node, 
-					error("Array index out of bounds (at %s): 0-%d", backup, size - 1));
+					error_static(ERR_OUT_OF_BOUNDS));
 				json_decref(node);
 				return node;
 			}
 
 			assign_and_prune(&node, json_array_get(node, idx));
 		} else {
-			const char *end = url;
+			char name[256];
+			json_t *value = NULL;
 
-			while (*end != '\0' && *end != '/') end++;
+			if (len < sizeof name) {
+				memcpy(name, segment, len);
+				name[len] = '\0';
+				value = json_object_get(node, name);
+			}
 
-			{
-				char *name = strndup(url, end - url);
-				json_t *value = json_object_get(node, name);
-				free(name);
+			if (value == NULL) {
+				assign_and_prune(&node,
+					error_static(ERR_INVALID_KEY));
+				json_decref(node);
+				return node;
+			}	
 
-				if (value == NULL) {
-					assign_and_prune(&node,
-						error("Invalid key (at %s)", backup));
-					json_decref(node);
-					return node;
-				}	
+			assign_and_prune(&node, value);
+		}
+	}
 
-				assign_and_prune(&node, value);
-			}
+	return node;
+}
 
-			url = end;
-		}
+/*
+ * What s selects of the /alsa tree. Pre-forked workers go through the
+ * snapshot they share: the whole tree is enumerated at most once per
+ * change and cut down to s here instead. Right after boot, while saved
+ * values go back onto the cards, the saved tree answers (see state.h).
+ */
+static json_t*
+alsa_tree (struct request *req, struct select s)
+{
+	struct select all = { NULL, -1 };
+	json_t *tree, *node;
+
+	if ((tree = state_tree())) {
+		req->stale = 1;
+	} else if (!snapshot_enabled()) {
+		return get_alsa(s);
+	}
+
+	if (tree == NULL && (tree = snapshot_get()) == NULL) {
+		uint64_t changes = snapshot_changes();
+
+		tree = get_alsa(all);
+		snapshot_put(tree, changes);
 	}
 
+	node = select_json(tree, s);
+	json_decref(tree);
+
 	return node;
 }
 
+/* decimal in arg to *value, left alone when arg is NULL; -1 unless an int >= 0 */
 static int
-alsa_handler (void *cls, struct MHD_Connection *connection,
-	      const char *url,
-	      const char *method, const char *version,
-	      const char *upload_data,
-	      size_t *upload_data_size, void **con_cls)
+parse_count (const char *arg, int *value)
 {
-	char *page;
+	char *end;
+	long n;
+
+	if (arg == NULL)
+		return 0;
+
+	errno = 0;
+	n = strtol(arg, &end, 10);
+
+	if (end == arg || *end != '\0' || errno || n < 0 || n > INT_MAX)
+		return -1;
+
+	*value = n;
+
+	return 0;
+}
+
+/* alsa_tree() would answer without enumerating the cards */
+static int
+tree_kept (void)
+{
+	return state_restoring() || snapshot_fresh();
+}
+
+/* ?fields=a,b.c&depth=N narrow what get_alsa() enumerates */
+static int
+alsa_handler (struct request *req)
+{
+	const char *fields = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "fields");
+	const char *depth = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "depth");
+	struct field *selection;
+	char cache_key[512];
+	json_t *node;
+	int levels = -1;
+	int ret;
+
+	if (parse_count(depth, &levels) < 0) {
+		node = error(ERR_BAD_REQUEST, "Invalid depth: %s", depth);
+	} else if ((selection = select_compile(req->nsegments, req->segment, req->segment_len,
+					       fields, levels)) == NULL) {
+		node = error(ERR_BAD_REQUEST, "Invalid fields: %s", fields);
+	} else {
+		node = json_walk(alsa_tree(req, select_root(selection)),
+				 req->nsegments, req->segment, req->segment_len);
+		select_free(selection);
+	}
+
+	snprintf(cache_key, sizeof cache_key, "%s?fields=%s&depth=%s",
+		 req->url, fields ? fields : "", depth ? depth : "");
+
+	ret = queue_node(req, node,
+		format_negotiate(MHD_lookup_connection_value(req->connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT)),
+		cache_key);
+
+	json_decref(node);
+
+	return ret;
+}
+
+/* /alsa.txt: the cards as amixer prints them, one request for shell clients */
+static int
+alsa_text_handler (struct request *req)
+{
+	static const char * const path[] = { "alsa", "cards" };
+	static const size_t path_len[] = { 4, 5 };
 	struct MHD_Response *response;
+	struct field *selection;
+	struct text text = { NULL, 0, 0 };
+	json_t *cards;
+	int ret;
+
+	/* only what amixer_card() prints gets enumerated */
+	selection = select_compile(2, path, path_len, AMIXER_FIELDS, -1);
+	cards = json_walk(alsa_tree(req, select_root(selection)), 2, path, path_len);
+	select_free(selection);
+
+	if (json_object_get(cards, "code")) {
+		ret = queue_node(req, cards, FMT_JSON, NULL);
+		json_decref(cards);
+
+		return ret;
+	}
+
+	amixer_cards(&text, cards);
+	json_decref(cards);
+
+	response = MHD_create_response_from_buffer (text.len, text.data, MHD_RESPMEM_MUST_FREE);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=utf-8");
+
+	ret = queue_response (req, MHD_HTTP_OK, response, text.len);
+	MHD_destroy_response (response);
+
+	return ret;
+}
+
+#define MAX_BATCH 256
+#define MAX_BODY (64 * 1024)
+
+/*
+ * Gather the request body across handler calls. MHD calls first with the
+ * headers alone, then once per chunk, then with nothing left; 1 from the
+ * last call on.
+ */
+static int
+read_body (struct request *req)
+{
+	size_t size = *req->upload_data_size;
+
+	if (!req->reading) {
+		req->reading = 1;
+		return 0;
+	}
+
+	if (size == 0)
+		return 1;
+
+	if (req->body_len + size > MAX_BODY) {
+		req->body_truncated = 1;
+		size = MAX_BODY - req->body_len;
+	}
+
+	req->body = realloc(req->body, req->body_len + size);
+	memcpy(req->body + req->body_len, req->upload_data, size);
+	req->body_len += size;
+	*req->upload_data_size = 0;
+
+	return 0;
+}
+
+/* POST /alsa/cards/N/controls { "numid": n, "value": [...] }, see ctl.h */
+static int
+alsa_write_handler (struct request *req)
+{
+	json_t *command, *node;
+	char path[64];
+	int card, n = 0, ret;
+
+	snprintf(path, sizeof path, "%s", req->url);
+
+	if (!ctl_enabled() || sscanf(path, "/alsa/cards/%d/controls%n", &card, &n) != 1 ||
+	    (path[n] != '\0' && strcmp(path + n, "/"))) {
+		node = error_static(ERR_METHOD);
+	} else if (!read_body(req)) {
+		return MHD_YES;
+	} else if (req->body_truncated ||
+		   (command = json_loadb(req->body, req->body_len, 0, NULL)) == NULL) {
+		node = error(ERR_BAD_REQUEST, "Expected a JSON object");
+	} else {
+		node = ctl_write(card, command);
+		json_decref(command);
+	}
+
+	ret = queue_node(req, node, FMT_JSON, NULL);
+	json_decref(node);
+
+	return ret;
+}
+
+struct batch_path {
+	const char *path;
+	int nsegments;
+	const char *segment[MAX_SEGMENTS];
+	size_t segment_len[MAX_SEGMENTS];
+};
+
+struct batch {
+	struct batch_path *paths;
+	int npaths;
+	int overflow;
+};
+
+static void
+add_path (struct batch *batch, const char *path)
+{
+	if (batch->npaths == MAX_BATCH) {
+		batch->overflow = 1;
+		return;
+	}
+
+	batch->paths[batch->npaths++].path = path;
+}
+
+static int
+collect_path (void *cls, enum MHD_ValueKind kind, const char *key, const char *value)
+{
+	if (!strcmp(key, "path") && value)
+		add_path(cls, value);
+
+	return MHD_YES;
+}
+
+/* the paths as a JSON array of strings */
+static json_t*
+parse_batch (struct request *req, struct batch *batch)
+{
+	json_t *list, *path;
+	size_t i;
+
+	if (req->body_truncated ||
+	    (list = json_loadb(req->body, req->body_len, 0, NULL)) == NULL)
+		return error(ERR_BAD_REQUEST, "Expected a JSON array of paths");
+
+	if (!json_is_array(list)) {
+		json_decref(list);
+		return error(ERR_BAD_REQUEST, "Expected a JSON array of paths");
+	}
+
+	json_array_foreach(list, i, path) {
+		if (!json_is_string(path)) {
+			json_decref(list);
+			return error(ERR_BAD_REQUEST, "Path %zu is not a string", i);
+		}
+		add_path(batch, json_string_value(path));
+	}
+
+	return list;
+}
+
+/* one entry of the /batch result */
+static json_t*
+batch_item (json_t *alsa, const struct batch_path *p, const struct field *filter)
+{
+	json_t *item = json_object();
+	json_t *node;
+
+	if (p->nsegments < 0) {
+		node = error_static(ERR_NOT_FOUND);
+	} else {
+		json_t *walked = json_walk(json_incref(alsa), p->nsegments, p->segment, p->segment_len);
+
+		/* the shared enumeration may hold more than this path asked for */
+		node = select_json(walked, select_root(filter));
+		json_decref(walked);
+	}
+
+	json_object_set_new(item, "path", json_string(p->path));
+	json_object_set_new(item, "status", json_integer(error_status(node)));
+	json_object_set_new(item, "value", node);
+
+	return item;
+}
+
+/*
+ * GET /batch?path=/alsa/...&path=... or POST /batch with a JSON array of
+ * paths. All of them are answered from a single enumeration covering
+ * every card they touch; each gets its own status in the result.
+ */
+static int
+batch_handler (struct request *req)
+{
+	const char *fields = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "fields");
+	const char *depth_arg = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "depth");
+	int depth = -1;
+	struct batch batch = { NULL, 0, 0 };
+	struct field *selection, *filter = NULL;
+	json_t *list = NULL, *alsa, *result;
+	uint64_t paths_hash = COMPRESS_HASH_INIT;
+	char cache_key[512];
+	int i, ret;
+
+	if (req->method == METHOD_POST && !read_body(req))
+		return MHD_YES;
+
+	batch.paths = calloc(MAX_BATCH, sizeof *batch.paths);
+
+	if (req->method == METHOD_POST)
+		list = parse_batch(req, &batch);
+	else
+		MHD_get_connection_values(req->connection, MHD_GET_ARGUMENT_KIND, collect_path, &batch);
+
+	if (list && error_status(list) != MHD_HTTP_OK) {
+		result = json_incref(list);
+	} else if (batch.overflow) {
+		result = error(ERR_BAD_REQUEST, "At most %d paths per batch", MAX_BATCH);
+	} else if (parse_count(depth_arg, &depth) < 0) {
+		result = error(ERR_BAD_REQUEST, "Invalid depth: %s", depth_arg);
+	} else if ((filter = select_compile(0, NULL, NULL, fields, depth)) == NULL) {
+		/* fields and depth apply to every path, relative to what it addresses */
+		result = error(ERR_BAD_REQUEST, "Invalid fields: %s", fields);
+	} else {
+		selection = select_new();
+		for (i = 0; i < batch.npaths; i++) {
+			struct batch_path *p = &batch.paths[i];
+
+			p->nsegments = router_split(p->path, p->segment, p->segment_len);
+
+			/* the tree starts at /alsa, anything else is simply not there */
+			if (p->nsegments > 0 && p->segment_len[0] == 4 && !strncmp(p->segment[0], "alsa", 4))
+				select_add(selection, p->nsegments, p->segment, p->segment_len, fields, depth);
+			else
+				p->nsegments = -1;
+		}
+
+		alsa = alsa_tree(req, select_root(selection));
+		select_free(selection);
+
+		result = json_array();
+		for (i = 0; i < batch.npaths; i++)
+			json_array_append_new(result, batch_item(alsa, &batch.paths[i], filter));
+
+		json_decref(alsa);
+	}
+
+	/* one slot per set of paths, however they came: a NUL ends each */
+	for (i = 0; i < batch.npaths; i++)
+		paths_hash = compress_hash(paths_hash, batch.paths[i].path, strlen(batch.paths[i].path) + 1);
+
+	snprintf(cache_key, sizeof cache_key, "%s?fields=%s&depth=%s&paths=%016llx",
+		 req->url, fields ? fields : "", depth_arg ? depth_arg : "",
+		 (unsigned long long) paths_hash);
+
+	ret = queue_node(req, result,
+		format_negotiate(MHD_lookup_connection_value(req->connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT)),
+		cache_key);
+
+	json_decref(result);
+	json_decref(list);
+	select_free(filter);
+	free(batch.paths);
+
+	return ret;
+}
+
+/* GET /ramp lists the running ramps, POST /ramp starts or cancels one */
+static int
+ramp_handler (struct request *req)
+{
+	json_t *command, *node;
 	int ret;
 
-	json_t *node = json_walk(get_alsa(), url);
+	if (req->method != METHOD_POST) {
+		node = ramp_list();
+	} else if (!read_body(req)) {
+		return MHD_YES;
+	} else if (req->body_truncated ||
+		   (command = json_loadb(req->body, req->body_len, 0, NULL)) == NULL) {
+		node = error(ERR_BAD_REQUEST, "Expected a JSON object");
+	} else {
+		node = ramp_command(command);
+		json_decref(command);
+	}
 
-	page = json_dumps(node, 
-		JSON_INDENT(2) | 
-		JSON_PRESERVE_ORDER | 
-		JSON_ESCAPE_SLASH | 
-		JSON_ENCODE_ANY);
+	ret = queue_node(req, node, FMT_JSON, NULL);
+	json_decref(node);
+
+	return ret;
+}
 
+/* /groups lists them all, /groups/<name> reads or (POST) sets one */
+static int
+groups_handler (struct request *req)
+{
+	struct select all = { NULL, -1 };
+	const char *name = req->segment[req->route_segments];
+	size_t len = req->segment_len[req->route_segments];
+	json_t *command, *node;
+	int ret;
+
+	if (req->nsegments > req->route_segments + 1) {
+		node = error_static(ERR_NOT_FOUND);
+	} else if (req->nsegments == req->route_segments) {
+		node = req->method == METHOD_POST ? error_static(ERR_METHOD) : groups_tree(all);
+	} else if (req->method != METHOD_POST) {
+		node = group_get(name, len);
+	} else if (!read_body(req)) {
+		return MHD_YES;
+	} else if (req->body_truncated ||
+		   (command = json_loadb(req->body, req->body_len, 0, NULL)) == NULL) {
+		node = error(ERR_BAD_REQUEST, "Expected a JSON object");
+	} else {
+		node = group_set(name, len, command);
+		json_decref(command);
+	}
+
+	ret = queue_node(req, node, FMT_JSON, NULL);
 	json_decref(node);
 
-	response = MHD_create_response_from_buffer (strlen (page), (void*) page, MHD_RESPMEM_MUST_FREE);
+	return ret;
+}
+
+/* seconds in arg to *ms, left alone when arg is NULL; -1 unless a number >= 0 */
+static int
+parse_seconds (const char *arg, uint64_t *ms)
+{
+	char *end;
+	double seconds;
+
+	if (arg == NULL)
+		return 0;
 
-	ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+	seconds = strtod(arg, &end);
+
+	/* written so that NaN fails too */
+	if (end == arg || *end != '\0' || !(seconds >= 0))
+		return -1;
+
+	/* past what uint64_t holds the cast is undefined: clamp first */
+	*ms = seconds * 1000 < 18446744073709551616.0 ? (uint64_t) (seconds * 1000) : UINT64_MAX;
+
+	return 0;
+}
+
+/*
+ * ?since=&until= in unix seconds; ?card=0 and ?control=Master Playback
+ * Volume, the name on the card's control device, narrow it down
+ */
+static int
+history_handler (struct request *req)
+{
+	const char *since = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "since");
+	const char *until = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "until");
+	const char *card_arg = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "card");
+	const char *control = MHD_lookup_connection_value(req->connection, MHD_GET_ARGUMENT_KIND, "control");
+	uint64_t since_ms = 0, until_ms = UINT64_MAX;
+	int card = -1;
+	json_t *node;
+	int ret;
+
+	if (parse_seconds(since, &since_ms) < 0)
+		node = error(ERR_BAD_REQUEST, "Invalid since: %s", since);
+	else if (parse_seconds(until, &until_ms) < 0)
+		node = error(ERR_BAD_REQUEST, "Invalid until: %s", until);
+	else if (parse_count(card_arg, &card) < 0)
+		node = error(ERR_BAD_REQUEST, "Invalid card: %s", card_arg);
+	else
+		node = history_query(since_ms, until_ms, card, control);
+
+	ret = queue_node(req, node, FMT_JSON, NULL);
+	json_decref(node);
+
+	return ret;
+}
+
+/* /events: the mixer as it changes, see events.h */
+static int
+events_handler (struct request *req)
+{
+	struct MHD_Response *response = events_response(req->connection);
+	int ret;
+
+	if (response == NULL) {
+		json_t *node = error_static(ERR_INTERNAL);
+
+		ret = queue_node(req, node, FMT_JSON, NULL);
+		json_decref(node);
+
+		return ret;
+	}
+
+	ret = queue_response (req, MHD_HTTP_OK, response, 0);
 	MHD_destroy_response (response);
 
 	return ret;
 }
 
-static const struct mapping {
-	const char *prefix;
-	MHD_AccessHandlerCallback handler;
+static int
+metrics_handler (struct request *req)
+{
+	struct MHD_Response *response;
+	size_t len;
+	char *text;
+	int ret;
+
+	if ((text = metrics_render(&len)) == NULL) {
+		json_t *node = error_static(ERR_INTERNAL);
+
+		ret = queue_node(req, node, FMT_JSON, NULL);
+		json_decref(node);
+
+		return ret;
+	}
+
+	response = MHD_create_response_from_buffer (len, text, MHD_RESPMEM_MUST_FREE);
+	MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; version=0.0.4");
+
+	ret = queue_response (req, MHD_HTTP_OK, response, len);
+	MHD_destroy_response (response);
+
+	return ret;
 }
+
+/* compiled into the router trie by run_server() */
+static const struct route
 mappings[] = {
-	{ "/alsa", alsa_handler },
-	{ "/", file_handler },
+	{ MHD_HTTP_METHOD_GET, "/alsa", alsa_handler, ROUTE_PREFIX | ROUTE_EXPENSIVE | ROUTE_TREE },
+	{ MHD_HTTP_METHOD_POST, "/alsa", alsa_write_handler, ROUTE_PREFIX },
+	{ MHD_HTTP_METHOD_GET, "/alsa.txt", alsa_text_handler, ROUTE_EXPENSIVE | ROUTE_TREE },
+	{ MHD_HTTP_METHOD_GET, "/batch", batch_handler, ROUTE_EXPENSIVE | ROUTE_TREE },
+	{ MHD_HTTP_METHOD_POST, "/batch", batch_handler, ROUTE_EXPENSIVE | ROUTE_TREE },
+	{ MHD_HTTP_METHOD_GET, "/ramp", ramp_handler, 0 },
+	{ MHD_HTTP_METHOD_POST, "/ramp", ramp_handler, 0 },
+	{ MHD_HTTP_METHOD_GET, "/groups", groups_handler, ROUTE_PREFIX | ROUTE_EXPENSIVE },
+	{ MHD_HTTP_METHOD_POST, "/groups", groups_handler, ROUTE_PREFIX | ROUTE_EXPENSIVE },
+	{ MHD_HTTP_METHOD_GET, "/history", history_handler, 0 },
+	{ MHD_HTTP_METHOD_GET, "/events", events_handler, 0 },
+	{ MHD_HTTP_METHOD_GET, "/metrics", metrics_handler, 0 },
+	{ MHD_HTTP_METHOD_GET, "/", file_handler, ROUTE_PREFIX },
 };
 
+#define ROUTES (sizeof(mappings)/sizeof(mappings[0]))
+
 
 static int
 handler (void *cls, struct MHD_Connection *connection,
@@ -178,66 +812,581 @@ handler (void *cls, struct MHD_Connection *connection,
 	 const char *upload_data,
 	 size_t *upload_data_size, void **con_cls)
 {
-	int i;
+	struct request *req = *con_cls;
+	struct timespec before, after;
+	route_handler route;
+	int status, ret;
+
+	/* (req, method, url), later request__done (req, status, us) */
+	if (req->connection == NULL) {
+		PROBE3(request__start, req, method, url);
+		trace_headers(req->trace, connection);
+	}
+	if (*upload_data_size > 0)
+		trace_body(req->trace, upload_data, *upload_data_size);
 
-	for (i = 0; i < sizeof(mappings)/sizeof(mappings[0]); i++) {
-		if (!strncmp(mappings[i].prefix, url, strlen(mappings[i].prefix)))
-			return mappings[i].handler(
-				cls, connection, url, method, version, upload_data, upload_data_size, con_cls);
+	req->connection = connection;
+	req->url = url;
+	req->upload_data = upload_data;
+	req->upload_data_size = upload_data_size;
+	req->con_cls = con_cls;
+	snprintf(req->method_name, sizeof req->method_name, "%s", method);
+
+	if ((route = router_match(req, method, &status)) == NULL) {
+		json_t *node = error_static(status == MHD_HTTP_METHOD_NOT_ALLOWED ? ERR_METHOD : ERR_NOT_FOUND);
+		int ret = queue_node(req, node, FMT_JSON, NULL);
+
+		json_decref(node);
+		return ret;
 	}
 
-	return MHD_NO;
+	if ((mappings[req->route_id].flags & ROUTE_EXPENSIVE) && !req->admitted &&
+	    !((mappings[req->route_id].flags & ROUTE_TREE) && tree_kept())) {
+		unsigned int retry_after;
+
+		if (!admission_check(&retry_after))
+			return queue_overloaded(req, retry_after);
+		req->admitted = 1;
+	}
+
+	/* only the handler holds up the round, not queueing in MHD or sending */
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	ret = route(req);
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	req->handler_us += (after.tv_sec - before.tv_sec) * 1000000LL +
+			   (after.tv_nsec - before.tv_nsec) / 1000;
+
+	return ret;
 }
 
+/* requests begun and not completed, what a shutdown waits for */
+static int in_flight;
+
 static void*
-log_uri (void *cls, const char *uri, struct MHD_Connection *con)
+request_started (void *cls, const char *uri, struct MHD_Connection *con)
 {
-	struct sockaddr **addr = (struct sockaddr **)MHD_get_connection_info (con, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+	struct request *req = calloc(1, sizeof *req);
 
-	fprintf(stderr, "URI: %s", uri);
-	if ((*addr)->sa_family == AF_INET) {
-		struct sockaddr_in *addr_in = (struct sockaddr_in *) *addr;
-		fprintf(stderr, " [%s]\n", inet_ntoa(addr_in->sin_addr));
-	} else {
-		fprintf(stderr, " [non AF_INET]\n");
-	}
+	clock_gettime(CLOCK_MONOTONIC, &req->start);
+	snprintf(req->uri, sizeof req->uri, "%s", uri);
+	req->route_id = -1;
+	req->trace = trace_start(uri);
 
-	return NULL;
+	metrics_in_flight(1);
+	in_flight++;
+
+	return req;
 }
 
+static void
+request_completed (void *cls, struct MHD_Connection *con, void **con_cls,
+		   enum MHD_RequestTerminationCode toe)
+{
+	struct request *req = *con_cls;
+	const union MHD_ConnectionInfo *info;
+	struct timespec now;
+
+	if (req == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	req->duration_us = (now.tv_sec - req->start.tv_sec) * 1000000LL +
+			   (now.tv_nsec - req->start.tv_nsec) / 1000;
+
+	info = MHD_get_connection_info (con, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+	accesslog_record(req, info ? info->client_addr : NULL);
+
+	PROBE3(request__done, req, req->status, req->duration_us);
+
+	if (req->admitted)
+		admission_cost(req->handler_us);
+
+	metrics_request(req->route_id, req->status, req->duration_us, req->bytes);
+	trace_finish(req->trace, req->method_name,
+		     req->route_id >= 0 ? mappings[req->route_id].path : "",
+		     req->status, req->duration_us);
+	metrics_in_flight(-1);
+	in_flight--;
+
+	free(req->body);
+	free(req);
+	*con_cls = NULL;
+}
+
+#if MHD_VERSION >= 0x00095200
+static void
+connection_notify (void *cls, struct MHD_Connection *con, void **socket_context,
+		   enum MHD_ConnectionNotificationCode toe)
+{
+	metrics_connections(toe == MHD_CONNECTION_NOTIFY_STARTED ? 1 : -1);
+}
+#endif
+
 #define PORT 8888
+#define IDLE_TIMEOUT 1000
 
-int
-run_server (void)
+/* past these MHD refuses connections outright */
+#define MAX_CONNECTIONS 256
+#define MAX_CONNECTIONS_PER_IP 16
+/* seconds before an idle connection is closed */
+#define CONNECTION_TIMEOUT 30
+#define MAX_WORKERS 64
+
+/* seconds the requests in flight get to finish once told to stop */
+#define DRAIN_TIMEOUT 10
+
+/* set in a replacement started by SIGHUP: the pid to retire */
+#define REPLACES_ENV "WEBMIXER_REPLACES"
+
+static volatile sig_atomic_t got_stop, got_restart, got_child;
+
+static void
+on_signal (int sig)
+{
+	switch (sig) {
+	case SIGHUP:
+		got_restart = 1;
+		break;
+	case SIGCHLD:
+		got_child = 1;
+		break;
+	default:
+		got_stop = 1;
+		break;
+	}
+}
+
+/* signals stay blocked except while waiting with *wait_mask */
+static void
+setup_signals (sigset_t *wait_mask)
 {
-	struct MHD_Daemon *daemon;
-	daemon = MHD_start_daemon (MHD_USE_DEBUG, PORT, NULL, NULL,
-		             &handler, NULL, MHD_OPTION_URI_LOG_CALLBACK, log_uri, NULL, MHD_OPTION_END);
+	static const int signals[] = { SIGTERM, SIGINT, SIGHUP, SIGCHLD };
+	struct sigaction sa;
+	sigset_t block;
+	size_t i;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = on_signal;
+	sigemptyset(&block);
+
+	for (i = 0; i < sizeof signals / sizeof signals[0]; i++) {
+		sigaction(signals[i], &sa, NULL);
+		sigaddset(&block, signals[i]);
+	}
+
+	sigprocmask(SIG_BLOCK, &block, wait_mask);
+}
+
+/* run the command line again; the copy retires us once it listens */
+static void
+spawn_replacement (char **argv, const sigset_t *wait_mask)
+{
+	char pid[32];
+	pid_t child;
+
+	/* it would open the trace file again, truncating this one's records */
+	if (trace_enabled()) {
+		fprintf(stderr, "restart: not while tracing with -t, ignored\n");
+		return;
+	}
+
+	snprintf(pid, sizeof pid, "%d", (int) getpid());
+
+	if ((child = fork()) == 0) {
+		sigprocmask(SIG_SETMASK, wait_mask, NULL);
+		setenv(REPLACES_ENV, pid, 1);
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	if (child < 0)
+		perror("fork");
+}
+
+static void
+retire_predecessor (void)
+{
+	const char *pid = getenv(REPLACES_ENV);
+
+	if (pid && atoi(pid) > 1)
+		kill(atoi(pid), SIGTERM);
+
+	unsetenv(REPLACES_ENV);
+}
+
+static void
+add_fd (int fd, fd_set *set, int *maxfd)
+{
+	if (fd < 0)
+		return;
+
+	FD_SET(fd, set);
+	if (fd > *maxfd)
+		*maxfd = fd;
+}
+
+static struct MHD_Daemon*
+start_daemon (int listen_fd)
+{
+	/* idle /events streams are suspended, see events.c */
+	return MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SUSPEND_RESUME, 0, NULL, NULL,
+			     &handler, NULL,
+			     MHD_OPTION_URI_LOG_CALLBACK, request_started, NULL,
+			     MHD_OPTION_NOTIFY_COMPLETED, request_completed, NULL,
+#if MHD_VERSION >= 0x00095200
+			     MHD_OPTION_NOTIFY_CONNECTION, connection_notify, NULL,
+#endif
+			     MHD_OPTION_CONNECTION_LIMIT, (unsigned int) MAX_CONNECTIONS,
+			     MHD_OPTION_PER_IP_CONNECTION_LIMIT, (unsigned int) MAX_CONNECTIONS_PER_IP,
+			     MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) CONNECTION_TIMEOUT,
+			     MHD_OPTION_LISTEN_SOCKET, listen_fd,
+			     MHD_OPTION_END);
+}
+
+/*
+ * With SO_REUSEPORT every worker gets a socket of its own on the port and
+ * the kernel spreads connections over them; a replacement binds next to
+ * us the same way, so the port never goes unanswered during a restart.
+ */
+static int
+listen_tcp (uint16_t port)
+{
+	struct sockaddr_in addr;
+	int fd, on = 1;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on) < 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) < 0 ||
+	    bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0 ||
+	    listen(fd, SOMAXCONN) < 0) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Local clients skip the TCP stack on a unix socket; who may connect is up
+ * to the permissions of path. A stale socket left by a previous run is
+ * replaced, and nothing unlinks it on exit: by then it may belong to our
+ * replacement. All workers accept from the one socket.
+ */
+static int
+listen_unix (const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* a stale socket from a previous run goes, anything else stays */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "%s: exists and is not a socket\n", path);
+			close(fd);
+			return -1;
+		}
+		unlink(path);
+	}
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0 || listen(fd, SOMAXCONN) < 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+add_daemon (struct MHD_Daemon *daemon, fd_set *readfds, fd_set *writefds,
+	    fd_set *exceptfds, int *maxfd, unsigned MHD_LONG_LONG *timeout)
+{
+	unsigned MHD_LONG_LONG t;
+
+	if (daemon == NULL)
+		return;
+
+	MHD_get_fdset (daemon, readfds, writefds, exceptfds, maxfd);
+
+	if (MHD_get_timeout (daemon, &t) == MHD_YES && t < *timeout)
+		*timeout = t;
+}
+
+/* stop accepting; the connections already open carry on */
+static void
+quiesce (struct MHD_Daemon *daemon)
+{
+	MHD_socket fd;
+
+	if (daemon && (fd = MHD_quiesce_daemon (daemon)) != MHD_INVALID_SOCKET)
+		close(fd);
+}
+
+/*
+ * One process serving both sockets. argv is NULL in a worker, where
+ * SIGHUP is the parent's business.
+ */
+static int
+serve (const struct server_options *options, int tcp_fd, int unix_fd,
+       const sigset_t *wait_mask)
+{
+	struct MHD_Daemon *daemon, *local = NULL;
+	time_t drain_until = 0;
+
+	assets_init(options->docroot);
+	accesslog_start(STDERR_FILENO);
+	ramp_init();
+	cards_init();
+
+	daemon = start_daemon(tcp_fd);
 
 	if (NULL == daemon)
 		return 1;
 
-	while(1) {
+	if (unix_fd >= 0 && (local = start_daemon(unix_fd)) == NULL) {
+		MHD_stop_daemon (daemon);
+		return 1;
+	}
+
+	while (!drain_until || (in_flight > 0 && time(NULL) < drain_until)) {
 		fd_set readfds, writefds, exceptfds;
 		int maxfd = 0;
-		struct timeval timeout;
-		unsigned MHD_LONG_LONG mhd_timeout;
+		struct timespec timeout;
+		unsigned MHD_LONG_LONG mhd_timeout = IDLE_TIMEOUT;
+
+		if (got_restart) {
+			got_restart = 0;
+			if (options->argv)
+				spawn_replacement(options->argv, wait_mask);
+		}
+
+		if (got_child) {
+			pid_t dead;
+			int status;
+
+			got_child = 0;
+			while ((dead = waitpid(-1, &status, WNOHANG)) > 0)
+				state_child(dead, status);
+		}
+
+		if (got_stop && !drain_until) {
+			quiesce(daemon);
+			quiesce(local);
+			events_close();
+			drain_until = time(NULL) + DRAIN_TIMEOUT;
+		}
 
 		FD_ZERO(&readfds);
 		FD_ZERO(&writefds);
 		FD_ZERO(&exceptfds);
 
-		MHD_get_fdset (daemon, &readfds, &writefds, &exceptfds, &maxfd);
-		MHD_get_timeout (daemon, &mhd_timeout);
+		add_daemon(daemon, &readfds, &writefds, &exceptfds, &maxfd, &mhd_timeout);
+		add_daemon(local, &readfds, &writefds, &exceptfds, &maxfd, &mhd_timeout);
+		add_fd(assets_fd(), &readfds, &maxfd);
+		add_fd(ramp_fd(), &readfds, &maxfd);
+		add_fd(cards_fd(), &readfds, &maxfd);
+
 		timeout.tv_sec = mhd_timeout / 1000;
-		timeout.tv_usec = (mhd_timeout - (timeout.tv_sec * 1000)) * 1000;
+		timeout.tv_nsec = (mhd_timeout - (timeout.tv_sec * 1000)) * 1000000;
+
+		/* interrupted by a signal: the sets say nothing, go look at it */
+		if (pselect(maxfd + 1, &readfds, &writefds, &exceptfds, &timeout, wait_mask) < 0)
+			continue;
+		admission_round();
 
-		select(maxfd + 1, &readfds, &writefds, &exceptfds, &timeout);
 		MHD_run_from_select(daemon, &readfds, &writefds, &exceptfds);
+		if (local)
+			MHD_run_from_select(local, &readfds, &writefds, &exceptfds);
+
+		if (assets_fd() >= 0 && FD_ISSET(assets_fd(), &readfds))
+			assets_process();
+		if (ramp_fd() >= 0 && FD_ISSET(ramp_fd(), &readfds))
+			ramp_process();
+		if (cards_fd() >= 0 && FD_ISSET(cards_fd(), &readfds))
+			cards_process();
+		events_process();
+
+		if (options->state_file)
+			state_save(options->state_file, 0);
 	}
 
-	// provide means to reach here (perhaps SIGHUP)
+	if (options->state_file)
+		state_save(options->state_file, 1);
+
+	if (local)
+		MHD_stop_daemon (local);
 	MHD_stop_daemon (daemon);
 
+	accesslog_stop();
+
 	return 0;
 }
+
+/* worker 0 alone keeps the state file */
+static pid_t
+spawn_worker (const struct server_options *options, int i, int tcp_fd, int unix_fd,
+	      const sigset_t *wait_mask)
+{
+	struct server_options worker = *options;
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		worker.argv = NULL;
+		if (i > 0)
+			worker.state_file = NULL;
+		got_restart = got_child = 0;
+		exit(serve(&worker, tcp_fd, unix_fd, wait_mask));
+	}
+
+	if (pid < 0)
+		perror("fork");
+
+	return pid;
+}
+
+/*
+ * The parent only watches: a worker killed by a signal is started again
+ * on the same socket, so the connections queued there are not lost. On
+ * SIGTERM each worker is told to drain, and the parent waits for them.
+ */
+static int
+run_workers (const struct server_options *options, const int *tcp_fd, int unix_fd,
+	     const sigset_t *wait_mask)
+{
+	pid_t pid[MAX_WORKERS];
+	pid_t dead;
+	int i, status;
+
+	for (i = 0; i < options->workers; i++)
+		pid[i] = spawn_worker(options, i, tcp_fd[i], unix_fd, wait_mask);
+
+	while (!got_stop) {
+		sigsuspend(wait_mask);
+
+		if (got_restart) {
+			got_restart = 0;
+			spawn_replacement(options->argv, wait_mask);
+		}
+
+		if (!got_child)
+			continue;
+		got_child = 0;
+
+		while ((dead = waitpid(-1, &status, WNOHANG)) > 0) {
+			state_child(dead, status);
+			snapshot_reaped(dead);
+
+			for (i = 0; i < options->workers; i++) {
+				if (pid[i] != dead)
+					continue;
+
+				if (WIFSIGNALED(status)) {
+					fprintf(stderr, "worker %d killed by signal %d, restarting\n",
+						(int) dead, WTERMSIG(status));
+					pid[i] = spawn_worker(options, i, tcp_fd[i], unix_fd, wait_mask);
+				} else {
+					fprintf(stderr, "worker %d exited with %d\n",
+						(int) dead, WEXITSTATUS(status));
+					pid[i] = -1;
+				}
+			}
+		}
+	}
+
+	/* the workers' copies are closed as they exit: with ours gone too, the
+	 * kernel stops queueing connections nobody will accept */
+	for (i = 0; i < options->workers; i++)
+		close(tcp_fd[i]);
+	if (unix_fd >= 0)
+		close(unix_fd);
+
+	for (i = 0; i < options->workers; i++) {
+		if (pid[i] > 0)
+			kill(pid[i], SIGTERM);
+	}
+
+	for (i = 0; i < options->workers; i++) {
+		while (pid[i] > 0 && waitpid(pid[i], NULL, 0) < 0 && errno == EINTR)
+			;
+	}
+
+	return 0;
+}
+
+int
+run_server (const struct server_options *options)
+{
+	static const char *route_names[ROUTES];
+	static const char *route_methods[ROUTES];
+	int tcp_fd[MAX_WORKERS];
+	int unix_fd = -1;
+	sigset_t wait_mask;
+	int i;
+
+	if (options->workers < 1 || options->workers > MAX_WORKERS) {
+		fprintf(stderr, "workers: between 1 and %d\n", MAX_WORKERS);
+		return 1;
+	}
+
+	for (i = 0; i < ROUTES; i++) {
+		route_names[i] = mappings[i].path;
+		route_methods[i] = mappings[i].method;
+	}
+
+	router_init(mappings, ROUTES);
+	metrics_init(route_names, route_methods, ROUTES);
+
+	if (history_init() < 0)
+		return 1;
+
+	setup_signals(&wait_mask);
+
+	for (i = 0; i < options->workers; i++) {
+		if ((tcp_fd[i] = listen_tcp(PORT)) < 0)
+			return 1;
+	}
+
+	if (options->socket_path && (unix_fd = listen_unix(options->socket_path)) < 0)
+		return 1;
+
+	/* listening already: connections queue up until we get to them */
+	retire_predecessor();
+
+	if (options->state_file && state_open(options->state_file) < 0)
+		fprintf(stderr, "state: %s: %s, starting without\n", options->state_file, strerror(errno));
+
+	if (options->workers == 1)
+		return serve(options, tcp_fd[0], unix_fd, &wait_mask);
+
+	if (snapshot_init() < 0)
+		return 1;
+
+	return run_workers(options, tcp_fd, unix_fd, &wait_mask);
+}
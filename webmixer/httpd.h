@@ -0,0 +1,44 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef HTTPD_H
+#define HTTPD_H
+
+struct server_options {
+	const char *docroot;
+	/* also listen here when not NULL */
+	const char *socket_path;
+	/* pre-forked processes sharing the port; 1 serves in-process */
+	int workers;
+	/* the command line, run again by SIGHUP */
+	char **argv;
+	/* mixer state saved here, restored from after a reboot */
+	const char *state_file;
+};
+
+/*
+ * Serve until SIGTERM or SIGINT, then stop accepting and let the requests
+ * in flight finish. SIGHUP starts a new copy of the program, which binds
+ * the port alongside this one and then sends it SIGTERM.
+ */
+extern int run_server (const struct server_options *options);
+
+#endif
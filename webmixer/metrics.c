@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Metrics.
+ *
+ * Every thread that records something gets its own block of counters, so
+ * the hot path is a handful of plain increments with no lock and no
+ * shared cache line. Rendering /metrics sums the blocks. A thread that
+ * exits (the card writers of groups.c) leaves its counts to a block of
+ * retired ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "metrics.h"
+
+#define MAX_ROUTES 16
+#define BUCKETS (sizeof(bucket_us)/sizeof(bucket_us[0]))
+
+static const uint32_t bucket_us[] = {
+	250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+	100000, 250000, 500000, 1000000, 2500000, 5000000,
+};
+
+/* last slot collects every other status */
+static const unsigned int statuses[] = {
+	0, 200, 204, 304, 400, 404, 405, 406, 413, 500, 503,
+};
+#define STATUS_SLOTS (sizeof(statuses)/sizeof(statuses[0]) + 1)
+
+static const char *timer_names[TIMER_COUNT] = {
+	[TIMER_GET_CARDS]  = "get_cards",
+	[TIMER_MIXER_LOAD] = "snd_mixer_load",
+	[TIMER_ENCODE]     = "encode",
+};
+
+struct histogram {
+	uint64_t bucket[BUCKETS + 1];
+	uint64_t sum_us;
+	uint64_t count;
+};
+
+struct block {
+	struct histogram requests[MAX_ROUTES + 1][STATUS_SLOTS];
+	uint64_t bytes[MAX_ROUTES + 1];
+	struct histogram timers[TIMER_COUNT];
+	int64_t connections;
+	int64_t in_flight;
+
+	struct block *next;
+};
+
+static const char * const *route_names;
+static const char * const *route_methods;
+static int nroutes;
+
+static struct block *blocks;
+/* what exited threads counted */
+static struct block retired;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct block *local;
+static pthread_key_t block_key;
+static pthread_once_t block_once = PTHREAD_ONCE_INIT;
+
+
+static void
+add_histogram (struct histogram *to, const struct histogram *from)
+{
+	size_t i;
+
+	for (i = 0; i <= BUCKETS; i++)
+		to->bucket[i] += from->bucket[i];
+	to->sum_us += from->sum_us;
+	to->count += from->count;
+}
+
+static void
+add_block (struct block *to, const struct block *from)
+{
+	int route, slot, timer;
+
+	for (route = 0; route <= MAX_ROUTES; route++) {
+		for (slot = 0; slot < STATUS_SLOTS; slot++)
+			add_histogram(&to->requests[route][slot], &from->requests[route][slot]);
+		to->bytes[route] += from->bytes[route];
+	}
+	for (timer = 0; timer < TIMER_COUNT; timer++)
+		add_histogram(&to->timers[timer], &from->timers[timer]);
+	to->connections += from->connections;
+	to->in_flight += from->in_flight;
+}
+
+/* a thread exits: keep its counts, drop its block */
+static void
+retire_block (void *data)
+{
+	struct block *b = data, **p;
+
+	pthread_mutex_lock(&blocks_lock);
+	for (p = &blocks; *p && *p != b; p = &(*p)->next)
+		;
+	if (*p)
+		*p = b->next;
+	add_block(&retired, b);
+	pthread_mutex_unlock(&blocks_lock);
+
+	free(b);
+}
+
+static void
+create_key (void)
+{
+	pthread_key_create(&block_key, retire_block);
+}
+
+static struct block*
+get_block (void)
+{
+	if (local == NULL) {
+		local = calloc(1, sizeof *local);
+
+		pthread_once(&block_once, create_key);
+		pthread_setspecific(block_key, local);
+
+		pthread_mutex_lock(&blocks_lock);
+		local->next = blocks;
+		blocks = local;
+		pthread_mutex_unlock(&blocks_lock);
+	}
+
+	return local;
+}
+
+static void
+observe (struct histogram *h, uint32_t us)
+{
+	size_t i;
+
+	for (i = 0; i < BUCKETS && us > bucket_us[i]; i++)
+		;
+
+	h->bucket[i]++;
+	h->sum_us += us;
+	h->count++;
+}
+
+static int
+status_slot (unsigned int status)
+{
+	int i;
+
+	for (i = 0; i < STATUS_SLOTS - 1; i++) {
+		if (statuses[i] == status)
+			return i;
+	}
+
+	return STATUS_SLOTS - 1;
+}
+
+void
+metrics_init (const char * const *routes, const char * const *methods, int count)
+{
+	route_names = routes;
+	route_methods = methods;
+	nroutes = count < MAX_ROUTES ? count : MAX_ROUTES;
+}
+
+void
+metrics_request (int route_id, unsigned int status, uint32_t duration_us, uint64_t bytes)
+{
+	struct block *b = get_block();
+
+	/* unrouted requests and routes past MAX_ROUTES share the last row */
+	if (route_id < 0 || route_id >= nroutes)
+		route_id = MAX_ROUTES;
+
+	observe(&b->requests[route_id][status_slot(status)], duration_us);
+	b->bytes[route_id] += bytes;
+}
+
+void
+metrics_time (enum timer timer, const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	observe(&get_block()->timers[timer],
+		(now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+void
+metrics_connections (int delta)
+{
+	get_block()->connections += delta;
+}
+
+void
+metrics_in_flight (int delta)
+{
+	get_block()->in_flight += delta;
+}
+
+static void
+print_histogram (FILE *out, const char *name, const char *labels, const struct histogram *h)
+{
+	uint64_t cumulative = 0;
+	size_t i;
+
+	for (i = 0; i < BUCKETS; i++) {
+		cumulative += h->bucket[i];
+		fprintf(out, "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels,
+			bucket_us[i] / 1e6, (unsigned long long) cumulative);
+	}
+	cumulative += h->bucket[BUCKETS];
+	fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, (unsigned long long) cumulative);
+	fprintf(out, "%s_sum{%s} %.6f\n", name, labels, h->sum_us / 1e6);
+	fprintf(out, "%s_count{%s} %llu\n", name, labels, (unsigned long long) h->count);
+}
+
+static void
+route_label (char *label, size_t size, int route)
+{
+	if (route < nroutes)
+		snprintf(label, size, "route=\"%s\",method=\"%s\"", route_names[route], route_methods[route]);
+	else
+		snprintf(label, size, "route=\"other\",method=\"\"");
+}
+
+char*
+metrics_render (size_t *len)
+{
+	static struct block total;
+	struct block *b;
+	char *text;
+	FILE *out;
+	int route, slot, timer;
+
+	memset(&total, 0, sizeof total);
+
+	pthread_mutex_lock(&blocks_lock);
+	add_block(&total, &retired);
+	for (b = blocks; b; b = b->next)
+		add_block(&total, b);
+	pthread_mutex_unlock(&blocks_lock);
+
+	if ((out = open_memstream(&text, len)) == NULL)
+		return NULL;
+
+	fprintf(out, "# HELP webmixer_http_request_duration_seconds Time from request line to completion.\n");
+	fprintf(out, "# TYPE webmixer_http_request_duration_seconds histogram\n");
+	for (route = 0; route <= MAX_ROUTES; route++) {
+		for (slot = 0; slot < STATUS_SLOTS; slot++) {
+			char labels[128], label[96];
+
+			if (total.requests[route][slot].count == 0)
+				continue;
+
+			route_label(label, sizeof label, route);
+			if (slot < STATUS_SLOTS - 1)
+				snprintf(labels, sizeof labels, "%s,status=\"%u\"", label, statuses[slot]);
+			else
+				snprintf(labels, sizeof labels, "%s,status=\"other\"", label);
+
+			print_histogram(out, "webmixer_http_request_duration_seconds", labels, &total.requests[route][slot]);
+		}
+	}
+
+	fprintf(out, "# HELP webmixer_http_response_bytes_total Response body bytes queued.\n");
+	fprintf(out, "# TYPE webmixer_http_response_bytes_total counter\n");
+	for (route = 0; route <= MAX_ROUTES; route++) {
+		char label[96];
+
+		if (route >= nroutes && route < MAX_ROUTES)
+			continue;
+
+		route_label(label, sizeof label, route);
+		fprintf(out, "webmixer_http_response_bytes_total{%s} %llu\n", label,
+			(unsigned long long) total.bytes[route]);
+	}
+
+	fprintf(out, "# HELP webmixer_operation_duration_seconds Time spent in ALSA enumeration and encoding.\n");
+	fprintf(out, "# TYPE webmixer_operation_duration_seconds histogram\n");
+	for (timer = 0; timer < TIMER_COUNT; timer++) {
+		char labels[64];
+
+		snprintf(labels, sizeof labels, "op=\"%s\"", timer_names[timer]);
+		print_histogram(out, "webmixer_operation_duration_seconds", labels, &total.timers[timer]);
+	}
+
+	fprintf(out, "# HELP webmixer_connections Open client connections.\n");
+	fprintf(out, "# TYPE webmixer_connections gauge\n");
+	fprintf(out, "webmixer_connections %lld\n", (long long) total.connections);
+
+	fprintf(out, "# HELP webmixer_requests_in_flight Requests received and not yet completed.\n");
+	fprintf(out, "# TYPE webmixer_requests_in_flight gauge\n");
+	fprintf(out, "webmixer_requests_in_flight %lld\n", (long long) total.in_flight);
+
+	fclose(out);
+
+	return text;
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+enum timer {
+	TIMER_GET_CARDS,
+	TIMER_MIXER_LOAD,
+	TIMER_ENCODE,
+	TIMER_COUNT
+};
+
+/* route and method labels, indexed by route id */
+extern void metrics_init (const char * const *routes, const char * const *methods, int count);
+
+extern void metrics_request (int route_id, unsigned int status,
+			     uint32_t duration_us, uint64_t bytes);
+
+/* observe the time elapsed since start (CLOCK_MONOTONIC) */
+extern void metrics_time (enum timer timer, const struct timespec *start);
+
+extern void metrics_connections (int delta);
+extern void metrics_in_flight (int delta);
+
+/* Prometheus text exposition; the returned buffer is malloc()ed */
+extern char* metrics_render (size_t *len);
+
+static inline void
+metrics_start (struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+#endif
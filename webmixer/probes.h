@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes of provider "webmixer", for bpftrace or perf on a running
+ * server: bpftrace -l 'usdt:/usr/bin/webmixer:*' lists them. Each is a
+ * single nop plus an ELF note until a tracer attaches, so they stay in
+ * release builds. Arguments are evaluated regardless: pass only what is
+ * already at hand, never something computed for the probe.
+ *
+ * Without <sys/sdt.h> (see the Makefile) they compile to nothing.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(webmixer, name)
+#define PROBE1(name, a) DTRACE_PROBE1(webmixer, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(webmixer, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(webmixer, name, a, b, c)
+#else
+#define PROBE(name) do { } while (0)
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,440 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Server side fades. Each ramp steps one mixer element (one channel or
+ * all of them) from its current value to a target over a duration, either
+ * linearly in raw steps or linearly in dB. A single timerfd drives every
+ * ramp from the main loop, armed only while some ramp runs, and the mixer
+ * of each card stays open in between so a step costs one control write,
+ * skipped when the rounded value did not change.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "error.h"
+#include "alsa.h"
+#include "ramp.h"
+#include "history.h"
+#include "snapshot.h"
+#include "cards.h"
+
+#define MAX_RAMPS 64
+#define TICK_MS 10
+#define MAX_DURATION_MS (60 * 60 * 1000)
+
+enum curve { CURVE_LINEAR, CURVE_DB };
+
+static const char *curve_names[] = { "linear", "dB" };
+
+struct ramp {
+	int active;
+
+	int card;
+	unsigned int element;
+	snd_mixer_selem_id_t *sid;
+	int dir;
+	int channel;
+
+	/* raw steps, or 1/100 dB for CURVE_DB */
+	enum curve curve;
+	long from, to;
+	long last;
+
+	struct timespec start;
+	long duration_ms;
+};
+
+static struct ramp ramps[MAX_RAMPS];
+static int running;
+
+static snd_mixer_t *mixers[MAX_CARDS];
+static int timer_fd = -1;
+
+
+int
+ramp_init (void)
+{
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	return timer_fd < 0 ? -1 : 0;
+}
+
+int
+ramp_fd (void)
+{
+	return timer_fd;
+}
+
+static void
+arm (int on)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof its);
+	if (on) {
+		its.it_interval.tv_nsec = TICK_MS * 1000000L;
+		its.it_value = its.it_interval;
+	}
+
+	timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+static long
+elapsed_ms (const struct ramp *r)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - r->start.tv_sec) * 1000 +
+	       (now.tv_nsec - r->start.tv_nsec) / 1000000;
+}
+
+/* bring the card's open mixer up to date; NULL once its card went away */
+static snd_mixer_t*
+refresh (int card)
+{
+	if (mixers[card] && snd_mixer_handle_events(mixers[card]) < 0) {
+		/* -ENODEV: even if the number comes back, it is another handle */
+		snd_mixer_close(mixers[card]);
+		mixers[card] = NULL;
+	}
+
+	return mixers[card];
+}
+
+/* the card's mixer, kept open across ramps and brought up to date */
+static snd_mixer_t*
+card_mixer (int card, json_t **err)
+{
+	char name[32];
+
+	if (refresh(card))
+		return mixers[card];
+
+	snprintf(name, sizeof name, "hw:%d", card);
+
+	return mixers[card] = alsa_open_mixer(name, err);
+}
+
+static void
+stop (struct ramp *r)
+{
+	if (!r->active)
+		return;
+
+	r->active = 0;
+	if (--running == 0)
+		arm(0);
+}
+
+static void
+write_value (snd_mixer_elem_t *elem, const struct ramp *r, long value)
+{
+	const struct alsa_volume *v = &alsa_volume[r->dir];
+
+	if (r->curve == CURVE_DB) {
+		if (r->channel == ALL_CHANNELS)
+			v->set_dB_all(elem, value, 0);
+		else
+			v->set_dB(elem, r->channel, value, 0);
+	} else {
+		if (r->channel == ALL_CHANNELS)
+			v->set_all(elem, value);
+		else
+			v->set(elem, r->channel, value);
+	}
+}
+
+static void
+step (struct ramp *r)
+{
+	snd_mixer_elem_t *elem = mixers[r->card] ? snd_mixer_find_selem(mixers[r->card], r->sid) : NULL;
+	long t = elapsed_ms(r);
+	long value;
+
+	/* the element went away with its card */
+	if (elem == NULL) {
+		stop(r);
+		return;
+	}
+
+	if (t >= r->duration_ms)
+		value = r->to;
+	else
+		value = r->from + lround((double) (r->to - r->from) * t / r->duration_ms);
+
+	if (value != r->last) {
+		write_value(elem, r, value);
+		history_local(r->card, SOURCE_RAMP);
+		snapshot_touch();
+		r->last = value;
+	}
+
+	if (t >= r->duration_ms)
+		stop(r);
+}
+
+void
+ramp_process (void)
+{
+	uint64_t expirations;
+	int i;
+
+	if (read(timer_fd, &expirations, sizeof expirations) < 0)
+		return;
+
+	for (i = 0; i < MAX_CARDS; i++)
+		refresh(i);
+
+	for (i = 0; i < MAX_RAMPS; i++) {
+		if (ramps[i].active)
+			step(&ramps[i]);
+	}
+}
+
+static json_t*
+describe (const struct ramp *r)
+{
+	json_t *node = json_object();
+	char path[64];
+	double scale = r->curve == CURVE_DB ? 100.0 : 1.0;
+	long t = elapsed_ms(r);
+
+	snprintf(path, sizeof path, "/alsa/cards/%d/mixer/%u", r->card, r->element);
+
+	json_object_set_new(node, "path", json_string(path));
+	json_object_set_new(node, "direction", json_string(alsa_direction_names[r->dir]));
+	json_object_set_new(node, "channel", r->channel == ALL_CHANNELS ? json_null() :
+			    json_string(snd_mixer_selem_channel_name(r->channel)));
+	json_object_set_new(node, "curve", json_string(curve_names[r->curve]));
+	json_object_set_new(node, "from", json_real(r->from / scale));
+	json_object_set_new(node, "to", json_real(r->to / scale));
+	json_object_set_new(node, "duration", json_integer(r->duration_ms));
+	json_object_set_new(node, "elapsed", json_integer(t < r->duration_ms ? t : r->duration_ms));
+
+	return node;
+}
+
+json_t*
+ramp_list (void)
+{
+	json_t *list = json_array();
+	int i;
+
+	for (i = 0; i < MAX_RAMPS; i++) {
+		if (ramps[i].active)
+			json_array_append_new(list, describe(&ramps[i]));
+	}
+
+	return list;
+}
+
+/* a ramp on the same element and direction touching the same channels */
+static int
+overlaps (const struct ramp *r, int card, unsigned int element, int dir, int channel)
+{
+	return r->active && r->card == card && r->element == element && r->dir == dir &&
+	       (r->channel == channel || r->channel == ALL_CHANNELS || channel == ALL_CHANNELS);
+}
+
+/* the channel the current value is read from */
+static snd_mixer_selem_channel_id_t
+reference_channel (snd_mixer_elem_t *elem, int dir, int channel)
+{
+	int chn;
+
+	if (channel != ALL_CHANNELS)
+		return channel;
+
+	for (chn = 0; chn <= SND_MIXER_SCHN_LAST; chn++) {
+		if (alsa_volume[dir].has_channel(elem, chn))
+			return chn;
+	}
+
+	return SND_MIXER_SCHN_MONO;
+}
+
+/* fill r->from and r->to in the unit of the curve */
+static json_t*
+endpoints (struct ramp *r, snd_mixer_elem_t *elem, json_t *command)
+{
+	const struct alsa_volume *v = &alsa_volume[r->dir];
+	snd_mixer_selem_channel_id_t chn = reference_channel(elem, r->dir, r->channel);
+	json_t *perc = json_object_get(command, "perc");
+	json_t *raw = json_object_get(command, "raw");
+	json_t *dB = json_object_get(command, "dB");
+	long min, max, target = 0;
+
+	v->get_range(elem, &min, &max);
+
+	if (json_is_number(perc))
+		target = min + lround(json_number_value(perc) * (max - min) / 100);
+	else if (json_is_integer(raw))
+		target = json_integer_value(raw);
+	else if (!json_is_number(dB))
+		return error(ERR_BAD_REQUEST, "No target: give perc, raw or dB");
+
+	if (r->curve == CURVE_DB) {
+		long dmin, dmax;
+
+		if (v->get_dB_range(elem, &dmin, &dmax) < 0 || v->get_dB(elem, chn, &r->from) < 0)
+			return error(ERR_BAD_REQUEST, "Element has no dB scale");
+
+		if (json_is_number(dB))
+			r->to = lround(json_number_value(dB) * 100);
+		else if (v->ask_vol_dB(elem, target < min ? min : target > max ? max : target, &r->to) < 0)
+			return error(ERR_ALSA, "Cannot convert %ld to dB", target);
+
+		/* muted reads far below the scale */
+		r->from = r->from < dmin ? dmin : r->from > dmax ? dmax : r->from;
+		r->to = r->to < dmin ? dmin : r->to > dmax ? dmax : r->to;
+	} else {
+		v->get(elem, chn, &r->from);
+
+		if (json_is_number(dB) && v->ask_dB_vol(elem, lround(json_number_value(dB) * 100), 0, &target) < 0)
+			return error(ERR_BAD_REQUEST, "Element has no dB scale");
+
+		r->to = target < min ? min : target > max ? max : target;
+	}
+
+	return NULL;
+}
+
+json_t*
+ramp_command (json_t *command)
+{
+	const char *path = json_string_value(json_object_get(command, "path"));
+	const char *direction = json_string_value(json_object_get(command, "direction"));
+	const char *curve = json_string_value(json_object_get(command, "curve"));
+	json_t *duration = json_object_get(command, "duration");
+	int card, dir = 0, channel, n = 0, i;
+	unsigned int element;
+	struct ramp *r = NULL, candidate;
+	snd_mixer_t *mixer;
+	snd_mixer_elem_t *elem;
+	json_t *err = NULL;
+
+	if (path == NULL || sscanf(path, "/alsa/cards/%d/mixer/%u%n", &card, &element, &n) != 2 ||
+	    path[n] != '\0' || card < 0 || card >= MAX_CARDS)
+		return error(ERR_BAD_REQUEST, "Expected a path like /alsa/cards/0/mixer/1");
+
+	if (direction && (dir = !strcmp(direction, "capture") ? 1 : !strcmp(direction, "playback") ? 0 : -1) < 0)
+		return error(ERR_BAD_REQUEST, "Unknown direction %s", direction);
+
+	if ((mixer = card_mixer(card, &err)) == NULL)
+		return err;
+
+	for (elem = snd_mixer_first_elem(mixer), i = 0; elem && i < element; elem = snd_mixer_elem_next(elem))
+		i++;
+
+	if (elem == NULL)
+		return error_static(ERR_OUT_OF_BOUNDS);
+
+	if (!alsa_volume[dir].has_volume(elem))
+		return error(ERR_BAD_REQUEST, "Element has no %s volume", alsa_direction_names[dir]);
+
+	if ((channel = alsa_parse_channel(elem, dir, json_string_value(json_object_get(command, "channel")))) == NO_CHANNEL)
+		return error(ERR_BAD_REQUEST, "No such %s channel", alsa_direction_names[dir]);
+
+	if (json_is_true(json_object_get(command, "cancel"))) {
+		json_t *cancelled = json_object();
+
+		for (i = n = 0; i < MAX_RAMPS; i++) {
+			if (overlaps(&ramps[i], card, element, dir, channel)) {
+				stop(&ramps[i]);
+				n++;
+			}
+		}
+
+		json_object_set_new(cancelled, "cancelled", json_integer(n));
+		return cancelled;
+	}
+
+	memset(&candidate, 0, sizeof candidate);
+	candidate.card = card;
+	candidate.element = element;
+	candidate.dir = dir;
+	candidate.channel = channel;
+	candidate.curve = curve && !strcmp(curve, "dB") ? CURVE_DB : CURVE_LINEAR;
+	candidate.duration_ms = json_is_integer(duration) ? json_integer_value(duration) : 0;
+
+	if (curve && strcmp(curve, "dB") && strcmp(curve, "linear"))
+		return error(ERR_BAD_REQUEST, "Unknown curve %s", curve);
+
+	if (candidate.duration_ms < 0 || candidate.duration_ms > MAX_DURATION_MS)
+		return error(ERR_BAD_REQUEST, "Duration out of range");
+
+	/* read before retargeting, so a new ramp starts where the old one is */
+	if ((err = endpoints(&candidate, elem, command)))
+		return err;
+
+	/* a new command on the same channels takes over the running ramp */
+	for (i = 0; i < MAX_RAMPS; i++) {
+		if (overlaps(&ramps[i], card, element, dir, channel)) {
+			if (r == NULL && ramps[i].channel == channel)
+				r = &ramps[i];
+			else
+				stop(&ramps[i]);
+		}
+	}
+
+	for (i = 0; r == NULL && i < MAX_RAMPS; i++) {
+		if (!ramps[i].active)
+			r = &ramps[i];
+	}
+
+	if (r == NULL)
+		return error(ERR_INTERNAL, "Too many ramps running");
+
+	if (r->sid == NULL)
+		snd_mixer_selem_id_malloc(&r->sid);
+
+	candidate.sid = r->sid;
+	snd_mixer_selem_get_id(elem, candidate.sid);
+	candidate.last = candidate.from;
+	candidate.active = r->active;
+	clock_gettime(CLOCK_MONOTONIC, &candidate.start);
+	*r = candidate;
+
+	if (!r->active) {
+		r->active = 1;
+		if (running++ == 0)
+			arm(1);
+	}
+
+	/* nothing to wait for: set it now */
+	if (r->duration_ms == 0)
+		step(r);
+
+	return describe(r);
+}
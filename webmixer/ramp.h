@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef RAMP_H
+#define RAMP_H
+
+#include <jansson.h>
+
+/* the scheduler timer; -1 until ramp_init() */
+extern int ramp_init (void);
+extern int ramp_fd (void);
+
+/* step every running ramp; call when ramp_fd() is readable */
+extern void ramp_process (void);
+
+/*
+ * Start, retarget or cancel a ramp:
+ *
+ *   { "path": "/alsa/cards/0/mixer/3", "channel": "Front Left",
+ *     "direction": "playback", "perc": 40 | "raw": 12 | "dB": -20.5,
+ *     "duration": 1500, "curve": "linear" | "dB", "cancel": false }
+ *
+ * Only path and one target are required. Returns the ramp, or an error.
+ */
+extern json_t* ramp_command (json_t *command);
+
+/* the running ramps */
+extern json_t* ramp_list (void);
+
+#endif
@@ -0,0 +1,266 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Request router.
+ *
+ * Routes are compiled at startup into a trie of path segments. Children
+ * of a node live in a small hash table, so matching costs one hash probe
+ * per path segment no matter how many routes exist, and the split
+ * segments are handed over to the handler instead of being parsed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <microhttpd.h>
+
+#include "router.h"
+
+#define CHILD_BUCKETS 16
+
+struct node {
+	char *segment;
+	size_t len;
+
+	const struct route *exact[METHOD_COUNT];
+	const struct route *prefix[METHOD_COUNT];
+
+	struct node *children[CHILD_BUCKETS];
+	struct node *sibling;
+};
+
+static struct node root;
+static const struct route *table;
+
+static const char *method_names[METHOD_COUNT] = {
+	[METHOD_GET]    = MHD_HTTP_METHOD_GET,
+	[METHOD_POST]   = MHD_HTTP_METHOD_POST,
+	[METHOD_PUT]    = MHD_HTTP_METHOD_PUT,
+	[METHOD_DELETE] = MHD_HTTP_METHOD_DELETE,
+};
+
+
+static int
+parse_method (const char *method)
+{
+	int i;
+
+	/* MHD drops the body of HEAD responses by itself */
+	if (!strcmp(method, MHD_HTTP_METHOD_HEAD))
+		return METHOD_GET;
+
+	for (i = 0; i < METHOD_COUNT; i++) {
+		if (!strcmp(method, method_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+static unsigned int
+hash_segment (const char *s, size_t len)
+{
+	unsigned int hash = 5381;
+
+	while (len--)
+		hash = hash * 33 + (unsigned char) *s++;
+
+	return hash % CHILD_BUCKETS;
+}
+
+static struct node*
+child (struct node *node, const char *s, size_t len, int create)
+{
+	struct node **bucket = &node->children[hash_segment(s, len)];
+	struct node *c;
+
+	for (c = *bucket; c; c = c->sibling) {
+		if (c->len == len && !memcmp(c->segment, s, len))
+			return c;
+	}
+
+	if (!create)
+		return NULL;
+
+	c = calloc(1, sizeof *c);
+	c->segment = strndup(s, len);
+	c->len = len;
+	c->sibling = *bucket;
+	*bucket = c;
+
+	return c;
+}
+
+int
+router_split (const char *url, const char **segment, size_t *segment_len)
+{
+	int n = 0;
+
+	while (*url == '/') {
+		const char *end;
+
+		url++;
+		if (*url == '\0')
+			break;
+
+		if (n == MAX_SEGMENTS)
+			return -1;
+
+		end = url + strcspn(url, "/");
+		segment[n] = url;
+		segment_len[n] = end - url;
+		n++;
+
+		url = end;
+	}
+
+	return n;
+}
+
+void
+router_init (const struct route *routes, int count)
+{
+	int i;
+
+	table = routes;
+
+	for (i = 0; i < count; i++) {
+		const char *segment[MAX_SEGMENTS];
+		size_t segment_len[MAX_SEGMENTS];
+		struct node *node = &root;
+		int method = parse_method(routes[i].method);
+		int n, j;
+
+		n = router_split(routes[i].path, segment, segment_len);
+		if (method < 0 || n < 0)
+			abort();
+
+		for (j = 0; j < n; j++)
+			node = child(node, segment[j], segment_len[j], 1);
+
+		if (routes[i].flags & ROUTE_PREFIX)
+			node->prefix[method] = &routes[i];
+		else
+			node->exact[method] = &routes[i];
+	}
+}
+
+static int
+has_any (const struct route **handlers)
+{
+	int i;
+
+	for (i = 0; i < METHOD_COUNT; i++) {
+		if (handlers[i])
+			return 1;
+	}
+
+	return 0;
+}
+
+/* "GET, HEAD, POST" of handlers into allow */
+static void
+format_allow (const struct route **handlers, char *allow, size_t size)
+{
+	size_t len = 0;
+	int i;
+
+	allow[0] = '\0';
+
+	for (i = 0; i < METHOD_COUNT; i++) {
+		if (handlers[i] == NULL)
+			continue;
+
+		len += snprintf(allow + len, size - len, "%s%s%s", len ? ", " : "",
+				method_names[i], i == METHOD_GET ? ", " MHD_HTTP_METHOD_HEAD : "");
+		if (len >= size)
+			return;
+	}
+}
+
+route_handler
+router_match (struct request *req, const char *method_name, int *status)
+{
+	struct node *node = &root;
+	const struct route *route = NULL;
+	const struct route **known = NULL;
+	int method = parse_method(method_name);
+	int known_depth = -1, handler_depth = -1;
+	int i;
+
+	*status = MHD_HTTP_NOT_FOUND;
+	req->route_id = -1;
+
+	if ((req->nsegments = router_split(req->url, req->segment, req->segment_len)) < 0)
+		return NULL;
+
+	req->method = method;
+
+	/*
+	 * The most specific match wins: an exact route over any prefix, a
+	 * deeper prefix over a shallower one. If the most specific path does
+	 * not take this method, answer 405 rather than fall back.
+	 */
+	for (i = 0; ; i++) {
+		if (has_any(node->prefix)) {
+			known = node->prefix;
+			known_depth = 2 * i;
+			if (method >= 0 && node->prefix[method]) {
+				route = node->prefix[method];
+				handler_depth = 2 * i;
+				req->route_segments = i;
+			}
+		}
+
+		if (i == req->nsegments) {
+			if (has_any(node->exact)) {
+				known = node->exact;
+				known_depth = 2 * i + 1;
+				if (method >= 0 && node->exact[method]) {
+					route = node->exact[method];
+					handler_depth = 2 * i + 1;
+					req->route_segments = i;
+				}
+			}
+			break;
+		}
+
+		if ((node = child(node, req->segment[i], req->segment_len[i], 0)) == NULL)
+			break;
+	}
+
+	if (known_depth > handler_depth) {
+		*status = MHD_HTTP_METHOD_NOT_ALLOWED;
+		format_allow(known, req->allow, sizeof req->allow);
+		return NULL;
+	}
+
+	if (route == NULL)
+		return NULL;
+
+	req->route_id = route - table;
+
+	return route->handler;
+}
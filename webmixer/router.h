@@ -0,0 +1,119 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <microhttpd.h>
+
+#define MAX_SEGMENTS 32
+
+enum method {
+	METHOD_GET,
+	METHOD_POST,
+	METHOD_PUT,
+	METHOD_DELETE,
+	METHOD_COUNT
+};
+
+#define LOG_URI_SIZE 96
+
+/* the route also matches every path below it */
+#define ROUTE_PREFIX 1
+/* enumerates the cards: subject to admission control */
+#define ROUTE_EXPENSIVE 2
+/* answers from alsa_tree(): cheap, and let through, while a tree is kept */
+#define ROUTE_TREE 4
+
+/*
+ * One per HTTP request: allocated when MHD logs the URI, kept in con_cls
+ * across handler calls and released once the request completes.
+ */
+struct request {
+	struct MHD_Connection *connection;
+	const char *url;
+	enum method method;
+	const char *upload_data;
+	size_t *upload_data_size;
+	void **con_cls;
+
+	/* url split at '/': segment[i] is not NUL terminated */
+	int nsegments;
+	const char *segment[MAX_SEGMENTS];
+	size_t segment_len[MAX_SEGMENTS];
+
+	/* index of the matched route in the table, -1 if none */
+	int route_id;
+	/* segments matched by the route itself */
+	int route_segments;
+	/* on 405, the methods the path takes: the Allow header */
+	char allow[32];
+	/* let through by admission control, see admission.h */
+	int admitted;
+	/* spent in the handler, over all its calls: the admission cost */
+	uint32_t handler_us;
+
+	/* for the access log */
+	struct timespec start;
+	char method_name[8];
+	char uri[LOG_URI_SIZE];
+	unsigned int status;
+	uint64_t bytes;
+	/* answered from saved state, not the cards */
+	int stale;
+	uint32_t duration_us;
+
+	/* NULL unless webmixer records a trace */
+	struct trace *trace;
+
+	/* upload gathered so far, see read_body() */
+	int reading;
+	char *body;
+	size_t body_len;
+	int body_truncated;
+};
+
+typedef int (*route_handler) (struct request *req);
+
+struct route {
+	const char *method;
+	const char *path;
+	route_handler handler;
+	int flags;
+};
+
+/* split url at '/' into at most MAX_SEGMENTS segments; -1 if deeper */
+extern int router_split (const char *url, const char **segment, size_t *segment_len);
+
+/* compile routes into the dispatch trie; call once at startup */
+extern void router_init (const struct route *routes, int count);
+
+/*
+ * Split req->url into segments and find its handler. Returns NULL if the
+ * path is unknown (or too deep), setting *status to 404, or 405 when the
+ * path exists for other methods only.
+ */
+extern route_handler router_match (struct request *req, const char *method, int *status);
+
+#endif
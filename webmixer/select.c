@@ -0,0 +1,376 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * Selections compile into a small trie of member names. Path segments form
+ * a chain down to the addressed node, the requested fields hang below it.
+ * Lookups are a linear scan of a node's children: a field list is a
+ * handful of names, and most queries never get past the path chain.
+ *
+ * Several paths can share one trie (see /batch); it then selects the
+ * union of what each wants, possibly a little more, never less.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "select.h"
+
+/* paths indexing past this select the whole array */
+#define MAX_INDEX 4096
+
+struct field {
+	char *name;
+
+	/* indexes paths pick out of this array member, as a bitmap */
+	unsigned char *indexes;
+	size_t indexes_size;
+	/* some path wants every element */
+	int any_index;
+	/* depth limit restarting here, -1 to inherit */
+	int depth;
+	/* everything below is selected */
+	int all;
+	/* some path goes on below this node */
+	int through;
+	/* some path ends here */
+	int ends;
+
+	struct field *children;
+	struct field *next;
+};
+
+
+static struct field*
+new_field (const char *name, size_t len)
+{
+	struct field *f = calloc(1, sizeof *f);
+
+	f->name = malloc(len + 1);
+	memcpy(f->name, name, len);
+	f->name[len] = '\0';
+	f->depth = -1;
+
+	return f;
+}
+
+static struct field*
+find (const struct field *parent, const char *name, size_t len)
+{
+	struct field *f;
+
+	for (f = parent->children; f; f = f->next) {
+		if (!strncmp(f->name, name, len) && f->name[len] == '\0')
+			return f;
+	}
+
+	return NULL;
+}
+
+static struct field*
+child (struct field *parent, const char *name, size_t len)
+{
+	struct field *f = find(parent, name, len);
+
+	if (f == NULL) {
+		f = new_field(name, len);
+		f->next = parent->children;
+		parent->children = f;
+	}
+
+	return f;
+}
+
+static int
+is_index (const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!isdigit((unsigned char) s[i]))
+			return 0;
+	}
+
+	return len > 0;
+}
+
+static void
+add_index (struct field *f, const char *s, size_t len)
+{
+	size_t i, index = 0;
+
+	for (i = 0; i < len && index <= MAX_INDEX; i++)
+		index = index * 10 + (s[i] - '0');
+
+	if (index > MAX_INDEX) {
+		f->any_index = 1;
+		return;
+	}
+
+	if (index / 8 >= f->indexes_size) {
+		size_t size = index / 8 + 1;
+
+		f->indexes = realloc(f->indexes, size);
+		memset(f->indexes + f->indexes_size, 0, size - f->indexes_size);
+		f->indexes_size = size;
+	}
+
+	f->indexes[index / 8] |= 1 << index % 8;
+}
+
+/* "a.b.c" below node; a shorter path already there selects all of it */
+static int
+add_field (struct field *node, const char *s, size_t len)
+{
+	const char *end = s + len;
+
+	while (s < end) {
+		const char *dot = memchr(s, '.', end - s);
+		size_t n = (dot ? dot : end) - s;
+
+		if (n == 0)
+			return -1;
+
+		node = child(node, s, n);
+		s += n + (dot != NULL);
+
+		if (dot && s == end)
+			return -1;
+	}
+
+	node->all = 1;
+
+	return 0;
+}
+
+struct field*
+select_new (void)
+{
+	return new_field("", 0);
+}
+
+int
+select_add (struct field *root, int nsegments, const char * const *segment,
+	    const size_t *segment_len, const char *fields, int depth)
+{
+	struct field *node = root;
+	int indexed = 0;
+	int i;
+
+	for (i = 0; i < nsegments; i++) {
+		const char *s = segment[i];
+		size_t len = segment_len[i];
+
+		if (is_index(s, len)) {
+			/* nothing to narrow: json_walk() reports the error */
+			if (node == root || indexed) {
+				node->all = 1;
+				return 0;
+			}
+			add_index(node, s, len);
+			indexed = 1;
+		} else {
+			if (!indexed)
+				node->any_index = 1;
+
+			/* a depth limit set by another path must not cut this one */
+			node->through = 1;
+			node->depth = -1;
+
+			node = child(node, s, len);
+			indexed = 0;
+		}
+	}
+
+	if (!indexed)
+		node->any_index = 1;
+
+	/* with several limits on one node, enumerate for the laxest */
+	if (node->through || depth < 0 || (node->ends && node->depth < 0))
+		node->depth = -1;
+	else if (!node->ends || depth > node->depth)
+		node->depth = depth;
+	node->ends = 1;
+
+	if (fields == NULL || *fields == '\0') {
+		node->all = 1;
+		return 0;
+	}
+
+	while (*fields) {
+		const char *comma = strchr(fields, ',');
+		size_t len = comma ? (size_t) (comma - fields) : strlen(fields);
+
+		if (add_field(node, fields, len) < 0)
+			return -1;
+
+		fields += len + (comma != NULL);
+	}
+
+	return 0;
+}
+
+struct field*
+select_compile (int nsegments, const char * const *segment,
+		const size_t *segment_len, const char *fields, int depth)
+{
+	struct field *root = select_new();
+
+	if (select_add(root, nsegments, segment, segment_len, fields, depth) < 0) {
+		select_free(root);
+		return NULL;
+	}
+
+	return root;
+}
+
+void
+select_free (struct field *root)
+{
+	struct field *f, *next;
+
+	if (root == NULL)
+		return;
+
+	for (f = root->children; f; f = next) {
+		next = f->next;
+		select_free(f);
+	}
+
+	free(root->name);
+	free(root->indexes);
+	free(root);
+}
+
+struct select
+select_root (const struct field *root)
+{
+	struct select s = { root, root->depth };
+
+	return s;
+}
+
+static int
+member (struct select s, const char *key, struct select *sub)
+{
+	const struct field *f;
+
+	if (s.node == NULL || s.node->all) {
+		sub->node = NULL;
+		sub->depth = s.depth > 0 ? s.depth - 1 : s.depth;
+		return 1;
+	}
+
+	if ((f = find(s.node, key, strlen(key))) == NULL)
+		return 0;
+
+	sub->node = f;
+	if (f->depth >= 0)
+		sub->depth = f->depth;
+	else
+		sub->depth = s.depth > 0 ? s.depth - 1 : s.depth;
+
+	return 1;
+}
+
+int
+select_value (struct select s, const char *key)
+{
+	struct select sub;
+
+	return member(s, key, &sub);
+}
+
+int
+select_object (struct select s, const char *key, struct select *sub)
+{
+	if (s.depth == 0)
+		return 0;
+
+	return member(s, key, sub);
+}
+
+int
+select_index (struct select s, size_t i)
+{
+	const struct field *f = s.node;
+
+	if (f == NULL || f->any_index)
+		return 1;
+
+	return i / 8 < f->indexes_size && (f->indexes[i / 8] & 1 << i % 8);
+}
+
+/* objects or arrays of objects count as a level, arrays of scalars do not */
+static int
+is_container (json_t *value)
+{
+	size_t i;
+	json_t *element;
+
+	if (json_is_object(value))
+		return 1;
+
+	json_array_foreach(value, i, element) {
+		if (json_is_object(element))
+			return 1;
+	}
+
+	return 0;
+}
+
+json_t*
+select_json (json_t *node, struct select s)
+{
+	const char *key;
+	json_t *value, *copy;
+	size_t i;
+
+	if (json_is_array(node)) {
+		copy = json_array();
+
+		json_array_foreach(node, i, value)
+			json_array_append_new(copy, is_container(value) ? select_json(value, s) : json_incref(value));
+
+		return copy;
+	}
+
+	/* errors go through whole, whatever was selected */
+	if (!json_is_object(node) || json_object_get(node, "code"))
+		return json_incref(node);
+
+	copy = json_object();
+
+	json_object_foreach(node, key, value) {
+		struct select sub;
+
+		if (!is_container(value)) {
+			if (select_value(s, key))
+				json_object_set(copy, key, value);
+		} else if (select_object(s, key, &sub)) {
+			json_object_set_new(copy, key, select_json(value, sub));
+		}
+	}
+
+	return copy;
+}
@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef SELECT_H
+#define SELECT_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+/*
+ * What a request wants out of the /alsa tree: the path it addresses, and
+ * below it the ?fields= and ?depth= it asked for. Enumeration consults it
+ * before touching alsa-lib so that nothing unrequested is fetched.
+ *
+ * Arrays are transparent: a selection on an array applies to each of its
+ * elements, an index in the path restricts which ones are filled.
+ */
+struct field;
+
+/* cursor into a compiled selection, passed by value down the tree */
+struct select {
+	/* NULL: everything below */
+	const struct field *node;
+	/* container levels still allowed below, -1 for unlimited */
+	int depth;
+};
+
+/*
+ * fields is a comma separated list of dotted member paths, relative to
+ * the node the path addresses; NULL or "" selects everything. depth < 0 means
+ * no limit. NULL (or -1 from select_add) if fields does not parse.
+ */
+extern struct field* select_compile (int nsegments, const char * const *segment,
+				     const size_t *segment_len,
+				     const char *fields, int depth);
+extern void select_free (struct field *root);
+
+/* an empty selection, for select_add() to merge several paths into */
+extern struct field* select_new (void);
+extern int select_add (struct field *root, int nsegments, const char * const *segment,
+		       const size_t *segment_len, const char *fields, int depth);
+
+extern struct select select_root (const struct field *root);
+
+/* wanted scalar (or array of scalars) member */
+extern int select_value (struct select s, const char *key);
+
+/* wanted object member, or array of objects; sub is the selection inside */
+extern int select_object (struct select s, const char *key, struct select *sub);
+
+/* whether element i of the array s was selected */
+extern int select_index (struct select s, size_t i);
+
+/* a copy of node holding only what s selects; error objects stay whole */
+extern json_t* select_json (json_t *node, struct select s);
+
+#endif
@@ -0,0 +1,218 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * One anonymous shared mapping holds the serialized tree behind a
+ * sequence counter: odd while a writer copies in, so a reader that sees
+ * it change under its copy simply misses. Writers never wait for each
+ * other either; whoever loses the race for the owner slot skips the
+ * store. The slot names the writer's pid, so when a worker dies holding
+ * it the master can tell, throw the half-copied tree away and free it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <jansson.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_TTL_MS 200
+#define SNAPSHOT_SIZE (1024 * 1024)
+
+struct shared {
+	/* pid of the worker storing a tree, 0 when none */
+	pid_t owner;
+	uint64_t seq;
+	uint64_t changes;
+	/* writes the stored tree has seen */
+	uint64_t tree_changes;
+	uint64_t taken_ms;
+	size_t len;
+	char data[];
+};
+
+static struct shared *shared;
+
+/* this worker's parse of the stored tree, good while seq stays parsed_seq */
+static json_t *parsed;
+static uint64_t parsed_seq;
+
+
+static uint64_t
+now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+int
+snapshot_init (void)
+{
+	void *p = mmap(NULL, sizeof *shared + SNAPSHOT_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		perror("snapshot");
+		return -1;
+	}
+
+	/* the mapping comes zeroed: no tree, nothing written */
+	shared = p;
+
+	return 0;
+}
+
+int
+snapshot_enabled (void)
+{
+	return shared != NULL;
+}
+
+uint64_t
+snapshot_changes (void)
+{
+	return __atomic_load_n(&shared->changes, __ATOMIC_ACQUIRE);
+}
+
+void
+snapshot_touch (void)
+{
+	if (shared)
+		__atomic_add_fetch(&shared->changes, 1, __ATOMIC_RELEASE);
+}
+
+/* whether the tree stored as of seq is still good */
+static int
+fresh (uint64_t seq)
+{
+	return !(seq & 1) && shared->len > 0 &&
+	       shared->tree_changes == snapshot_changes() &&
+	       now_ms() - shared->taken_ms <= SNAPSHOT_TTL_MS;
+}
+
+int
+snapshot_fresh (void)
+{
+	return shared && fresh(__atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE));
+}
+
+json_t*
+snapshot_get (void)
+{
+	uint64_t seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE);
+	size_t len;
+	char *copy;
+	json_t *tree;
+
+	if (!fresh(seq))
+		return NULL;
+
+	/* stored trees are never changed, only replaced, bumping seq */
+	if (parsed && parsed_seq == seq)
+		return json_incref(parsed);
+
+	len = shared->len;
+	if (len > SNAPSHOT_SIZE || (copy = malloc(len)) == NULL)
+		return NULL;
+	memcpy(copy, shared->data, len);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) != seq) {
+		free(copy);
+		return NULL;
+	}
+
+	tree = json_loadb(copy, len, 0, NULL);
+	free(copy);
+
+	if (tree) {
+		json_decref(parsed);
+		parsed = json_incref(tree);
+		parsed_seq = seq;
+	}
+
+	return tree;
+}
+
+void
+snapshot_put (json_t *tree, uint64_t changes)
+{
+	pid_t none = 0;
+	uint64_t seq;
+	char *data;
+	size_t len;
+
+	if (__atomic_load_n(&shared->owner, __ATOMIC_RELAXED) != 0 ||
+	    (data = json_dumps(tree, JSON_COMPACT)) == NULL)
+		return;
+
+	len = strlen(data);
+
+	if (len <= SNAPSHOT_SIZE &&
+	    __atomic_compare_exchange_n(&shared->owner, &none, getpid(), 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		seq = __atomic_load_n(&shared->seq, __ATOMIC_RELAXED);
+		__atomic_store_n(&shared->seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		memcpy(shared->data, data, len);
+		shared->len = len;
+		shared->tree_changes = changes;
+		shared->taken_ms = now_ms();
+
+		__atomic_store_n(&shared->seq, seq + 2, __ATOMIC_RELEASE);
+		__atomic_store_n(&shared->owner, 0, __ATOMIC_RELEASE);
+
+		/* what we stored needs no parsing here */
+		json_decref(parsed);
+		parsed = json_incref(tree);
+		parsed_seq = seq + 2;
+	}
+
+	free(data);
+}
+
+void
+snapshot_reaped (pid_t pid)
+{
+	uint64_t seq;
+
+	/* dead, so it can no longer let go of the slot by itself */
+	if (shared == NULL || __atomic_load_n(&shared->owner, __ATOMIC_ACQUIRE) != pid)
+		return;
+
+	seq = __atomic_load_n(&shared->seq, __ATOMIC_RELAXED);
+	if (seq & 1) {
+		shared->len = 0;
+		__atomic_store_n(&shared->seq, seq + 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&shared->owner, 0, __ATOMIC_RELEASE);
+}
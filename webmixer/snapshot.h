@@ -0,0 +1,59 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <jansson.h>
+
+/*
+ * The full /alsa tree shared by pre-forked workers, so N workers polled
+ * at once enumerate the cards about once rather than N times. A snapshot
+ * is good until any worker writes a control or SNAPSHOT_TTL_MS passes,
+ * which bounds how long changes made by other programs go unseen.
+ */
+
+/* map the shared segment; call before forking, the children inherit it */
+extern int snapshot_init (void);
+
+extern int snapshot_enabled (void);
+
+/* the shared tree while still good, else NULL; shared, do not change it */
+extern json_t* snapshot_get (void);
+
+/* whether snapshot_get() would answer without anyone enumerating */
+extern int snapshot_fresh (void);
+
+/* writes seen so far; take it before enumerating the tree to store */
+extern uint64_t snapshot_changes (void);
+
+/* store tree, enumerated after changes writes; kept, do not change it after */
+extern void snapshot_put (json_t *tree, uint64_t changes);
+
+/* a control was written: every worker's next read enumerates again */
+extern void snapshot_touch (void);
+
+/* master only: worker pid is gone, free the store it may have left half done */
+extern void snapshot_reaped (pid_t pid);
+
+#endif
@@ -0,0 +1,522 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <asoundlib.h>
+#include <jansson.h>
+
+#include "alsa.h"
+#include "cards.h"
+#include "state.h"
+
+/* seconds between looks for changes worth saving */
+#define STATE_INTERVAL 60
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t) 7)
+
+static const struct state_header *header;
+static size_t mapped_len;
+
+/* shared with the restoring child, which clears it when done */
+static int *restoring;
+static pid_t restorer;
+
+static json_t *stale_tree;
+
+/* of the last file written, to skip writing the same again */
+static uint64_t saved_hash;
+static time_t last_save;
+
+
+static uint64_t
+fnv1a (const void *data, size_t len, uint64_t hash)
+{
+	const unsigned char *p = data;
+
+	while (len--)
+		hash = (hash ^ *p++) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+static const struct state_control*
+first_control (void)
+{
+	return (const void *) ((const char *) (header + 1) + ALIGN8(header->tree_len));
+}
+
+static const struct state_control*
+next_control (const struct state_control *c)
+{
+	return (const void *) ((const char *) c + c->size);
+}
+
+static int
+valid (size_t len)
+{
+	const char *end = (const char *) header + len;
+	const struct state_control *c;
+	uint32_t i;
+
+	if (len < sizeof *header || memcmp(header->magic, STATE_MAGIC, sizeof STATE_MAGIC) ||
+	    header->version != STATE_VERSION ||
+	    sizeof *header + ALIGN8(header->tree_len) + header->controls_len > len)
+		return 0;
+
+	for (i = 0, c = first_control(); i < header->ncontrols; i++, c = next_control(c)) {
+		if ((const char *) c + sizeof *c > end || c->size < sizeof *c || c->size % 8 ||
+		    (const char *) c + c->size > end ||
+		    sizeof *c + c->count * sizeof c->values[0] > c->size)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int
+find_card (const char *id)
+{
+	const snd_ctl_card_info_t *info;
+	int number;
+
+	for (number = cards_next(-1); number >= 0; number = cards_next(number)) {
+		if ((info = cards_info(number)) && !strncmp(snd_ctl_card_info_get_id(info), id, 16))
+			return number;
+	}
+
+	return -1;
+}
+
+static void
+restore_control (snd_ctl_t *handle, const struct state_control *c)
+{
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_value_t *value;
+	snd_ctl_elem_id_t *id;
+	char name[sizeof c->name + 1];
+	uint32_t i;
+	int err;
+
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&value);
+
+	memcpy(name, c->name, sizeof c->name);
+	name[sizeof c->name] = '\0';
+
+	snd_ctl_elem_id_set_interface(id, c->iface);
+	snd_ctl_elem_id_set_device(id, c->device);
+	snd_ctl_elem_id_set_subdevice(id, c->subdevice);
+	snd_ctl_elem_id_set_name(id, name);
+	snd_ctl_elem_id_set_index(id, c->index);
+
+	snd_ctl_elem_info_set_id(info, id);
+	if (snd_ctl_elem_info(handle, info) < 0 || !snd_ctl_elem_info_is_writable(info) ||
+	    snd_ctl_elem_info_get_type(info) != c->type || snd_ctl_elem_info_get_count(info) != c->count)
+		return;
+
+	snd_ctl_elem_value_set_id(value, id);
+
+	for (i = 0; i < c->count; i++) {
+		switch (c->type) {
+		case SND_CTL_ELEM_TYPE_BOOLEAN:
+			snd_ctl_elem_value_set_boolean(value, i, c->values[i]);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER:
+			snd_ctl_elem_value_set_integer(value, i, c->values[i]);
+			break;
+		case SND_CTL_ELEM_TYPE_INTEGER64:
+			snd_ctl_elem_value_set_integer64(value, i, c->values[i]);
+			break;
+		case SND_CTL_ELEM_TYPE_ENUMERATED:
+			snd_ctl_elem_value_set_enumerated(value, i, c->values[i]);
+			break;
+		case SND_CTL_ELEM_TYPE_BYTES:
+			snd_ctl_elem_value_set_byte(value, i, c->values[i]);
+			break;
+		}
+	}
+
+	if ((err = snd_ctl_elem_write(handle, value)) < 0)
+		fprintf(stderr, "state: restoring %s,%u: %s\n", name, c->index, snd_strerror(err));
+}
+
+/* in the child: one control handle per card, controls in file order */
+static void
+restore (void)
+{
+	const struct state_control *c;
+	snd_ctl_t *handle = NULL;
+	char card_id[sizeof c->card_id] = "";
+	uint32_t i;
+
+	for (i = 0, c = first_control(); i < header->ncontrols; i++, c = next_control(c)) {
+		if (strncmp(card_id, c->card_id, sizeof card_id)) {
+			char name[32];
+			int number;
+
+			if (handle)
+				snd_ctl_close(handle);
+			handle = NULL;
+			memcpy(card_id, c->card_id, sizeof card_id);
+
+			if ((number = find_card(card_id)) < 0)
+				continue;
+
+			snprintf(name, sizeof name, "hw:%d", number);
+			if (snd_ctl_open(&handle, name, 0) < 0)
+				handle = NULL;
+		}
+
+		if (handle)
+			restore_control(handle, c);
+	}
+
+	if (handle)
+		snd_ctl_close(handle);
+}
+
+/* when the system came up, in unix time */
+static time_t
+boot_time (void)
+{
+	struct timespec up;
+
+	clock_gettime(CLOCK_BOOTTIME, &up);
+
+	return time(NULL) - up.tv_sec;
+}
+
+int
+state_open (const char *path)
+{
+	struct stat st;
+	void *p;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return errno == ENOENT ? 0 : -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0 ||
+	    (p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	header = p;
+	mapped_len = st.st_size;
+
+	/* saved during this boot: the hardware still has it */
+	if (!valid(mapped_len) || (time_t) header->saved >= boot_time()) {
+		if (!valid(mapped_len))
+			fprintf(stderr, "state: %s: not a state file, ignored\n", path);
+		munmap(p, mapped_len);
+		header = NULL;
+		return 0;
+	}
+
+	restoring = mmap(NULL, sizeof *restoring, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (restoring == MAP_FAILED) {
+		restoring = NULL;
+		return -1;
+	}
+
+	*restoring = 1;
+
+	switch ((restorer = fork())) {
+	case 0:
+		restore();
+		__atomic_store_n(restoring, 0, __ATOMIC_RELEASE);
+		_exit(0);
+	case -1:
+		*restoring = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+state_child (pid_t pid, int status)
+{
+	if (pid != restorer || restorer <= 0)
+		return;
+
+	restorer = 0;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		fprintf(stderr, "state: restore did not finish, serving the cards as they are\n");
+
+	if (restoring)
+		__atomic_store_n(restoring, 0, __ATOMIC_RELEASE);
+}
+
+/* 1 once the restore is over, letting the saved state go then */
+static int
+live (void)
+{
+	if (restoring == NULL)
+		return 1;
+
+	if (__atomic_load_n(restoring, __ATOMIC_ACQUIRE))
+		return 0;
+
+	json_decref(stale_tree);
+	stale_tree = NULL;
+	munmap((void *) header, mapped_len);
+	munmap(restoring, sizeof *restoring);
+	header = NULL;
+	restoring = NULL;
+
+	return 1;
+}
+
+int
+state_restoring (void)
+{
+	return !live();
+}
+
+json_t*
+state_tree (void)
+{
+	json_t *alsa;
+
+	if (live())
+		return NULL;
+
+	if (stale_tree == NULL) {
+		stale_tree = json_loadb((const char *) (header + 1), header->tree_len, 0, NULL);
+		if ((alsa = json_object_get(stale_tree, "alsa")))
+			json_object_set_new(alsa, "stale", json_true());
+	}
+
+	return json_incref(stale_tree);
+}
+
+struct buffer {
+	char *data;
+	size_t len, size;
+};
+
+static void*
+append (struct buffer *b, const void *data, size_t len)
+{
+	void *p;
+
+	if (b->len + len > b->size) {
+		b->size = (b->len + len) * 2;
+		b->data = realloc(b->data, b->size);
+	}
+
+	p = b->data + b->len;
+	if (data)
+		memcpy(p, data, len);
+	else
+		memset(p, 0, len);
+	b->len += len;
+
+	return p;
+}
+
+static uint32_t
+save_card (struct buffer *b, int number)
+{
+	const snd_ctl_card_info_t *card = cards_info(number);
+	snd_ctl_elem_list_t *list;
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_value_t *value;
+	snd_ctl_t *handle;
+	uint32_t i, j, count = 0;
+	char name[32];
+
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&value);
+
+	snprintf(name, sizeof name, "hw:%d", number);
+	if (card == NULL || snd_ctl_open(&handle, name, 0) < 0)
+		return 0;
+
+	if (snd_ctl_elem_list_malloc(&list) < 0) {
+		snd_ctl_close(handle);
+		return 0;
+	}
+
+	if (snd_ctl_elem_list(handle, list) < 0 ||
+	    snd_ctl_elem_list_alloc_space(list, snd_ctl_elem_list_get_count(list)) < 0 ||
+	    snd_ctl_elem_list(handle, list) < 0)
+		goto out;
+
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++) {
+		struct state_control *c;
+		snd_ctl_elem_type_t type;
+		size_t size;
+
+		snd_ctl_elem_info_set_numid(info, snd_ctl_elem_list_get_numid(list, i));
+		if (snd_ctl_elem_info(handle, info) < 0 || !snd_ctl_elem_info_is_readable(info) ||
+		    !snd_ctl_elem_info_is_writable(info) || snd_ctl_elem_info_is_inactive(info))
+			continue;
+
+		type = snd_ctl_elem_info_get_type(info);
+		if (type == SND_CTL_ELEM_TYPE_IEC958 || type == SND_CTL_ELEM_TYPE_NONE)
+			continue;
+
+		snd_ctl_elem_value_set_numid(value, snd_ctl_elem_list_get_numid(list, i));
+		if (snd_ctl_elem_read(handle, value) < 0)
+			continue;
+
+		size = sizeof *c + snd_ctl_elem_info_get_count(info) * sizeof c->values[0];
+		c = append(b, NULL, size);
+
+		c->size = size;
+		c->iface = snd_ctl_elem_info_get_interface(info);
+		c->device = snd_ctl_elem_info_get_device(info);
+		c->subdevice = snd_ctl_elem_info_get_subdevice(info);
+		c->index = snd_ctl_elem_info_get_index(info);
+		c->type = type;
+		c->count = snd_ctl_elem_info_get_count(info);
+		/* both fit with their NUL in ALSA, the record is zeroed past it */
+		snprintf(c->card_id, sizeof c->card_id, "%s", snd_ctl_card_info_get_id(card));
+		snprintf(c->name, sizeof c->name, "%s", snd_ctl_elem_info_get_name(info));
+
+		for (j = 0; j < c->count; j++) {
+			switch (type) {
+			case SND_CTL_ELEM_TYPE_BOOLEAN:
+				c->values[j] = snd_ctl_elem_value_get_boolean(value, j);
+				break;
+			case SND_CTL_ELEM_TYPE_INTEGER:
+				c->values[j] = snd_ctl_elem_value_get_integer(value, j);
+				break;
+			case SND_CTL_ELEM_TYPE_INTEGER64:
+				c->values[j] = snd_ctl_elem_value_get_integer64(value, j);
+				break;
+			case SND_CTL_ELEM_TYPE_ENUMERATED:
+				c->values[j] = snd_ctl_elem_value_get_enumerated(value, j);
+				break;
+			default:
+				c->values[j] = snd_ctl_elem_value_get_byte(value, j);
+				break;
+			}
+		}
+
+		count++;
+	}
+
+out:
+	snd_ctl_elem_list_free_space(list);
+	snd_ctl_elem_list_free(list);
+	snd_ctl_close(handle);
+
+	return count;
+}
+
+static int
+write_file (const char *path, const struct buffer *b)
+{
+	char tmp[4096];
+	int fd, ok;
+
+	snprintf(tmp, sizeof tmp, "%s.tmp", path);
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		return -1;
+
+	ok = write(fd, b->data, b->len) == (ssize_t) b->len && fsync(fd) == 0;
+	close(fd);
+
+	if (!ok || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+state_save (const char *path, int force)
+{
+	struct select all = { NULL, -1 };
+	struct state_header *h;
+	struct buffer b = { NULL, 0, 0 };
+	json_t *tree;
+	char *json;
+	size_t tree_len, controls;
+	uint32_t ncontrols = 0;
+	uint64_t hash;
+	int number;
+
+	/* the first look is one interval in, not in the way of starting up */
+	if (last_save == 0)
+		last_save = time(NULL);
+
+	/* what the hardware holds mid-restore is not worth keeping */
+	if (!live() || (!force && time(NULL) - last_save < STATE_INTERVAL))
+		return;
+	last_save = time(NULL);
+
+	tree = get_alsa(all);
+	json = json_dumps(tree, JSON_COMPACT);
+	json_decref(tree);
+	if (json == NULL)
+		return;
+	tree_len = strlen(json);
+
+	append(&b, NULL, sizeof *h);
+	append(&b, json, tree_len);
+	append(&b, NULL, ALIGN8(tree_len) - tree_len);
+	free(json);
+
+	controls = b.len;
+	for (number = cards_next(-1); number >= 0; number = cards_next(number))
+		ncontrols += save_card(&b, number);
+
+	h = (struct state_header *) b.data;
+	memcpy(h->magic, STATE_MAGIC, sizeof STATE_MAGIC);
+	h->version = STATE_VERSION;
+	h->ncontrols = ncontrols;
+	h->tree_len = tree_len;
+	h->controls_len = b.len - controls;
+
+	/* the same state as last time, bar the date: spare the flash */
+	hash = fnv1a(b.data + sizeof *h, b.len - sizeof *h, 0xcbf29ce484222325ULL);
+	if (hash != saved_hash) {
+		h->saved = time(NULL);
+		if (write_file(path, &b) == 0)
+			saved_hash = hash;
+		else
+			fprintf(stderr, "state: writing %s: %s\n", path, strerror(errno));
+	}
+
+	free(b.data);
+}
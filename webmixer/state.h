@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <jansson.h>
+
+/*
+ * Saved mixer state, for a cold start: the /alsa tree to answer with
+ * before the cards are ready, and every control's id and values to put
+ * back on the hardware, as alsactl restore would. Native byte order, as
+ * the file never leaves the board:
+ *
+ *   struct state_header
+ *   tree_len bytes of compact JSON, padded to 8
+ *   ncontrols struct state_control, each followed by count values
+ */
+
+#define STATE_MAGIC "WMSTATE"
+#define STATE_VERSION 1
+
+struct state_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t ncontrols;
+	/* unix time */
+	uint64_t saved;
+	uint32_t tree_len;
+	uint32_t controls_len;
+};
+
+struct state_control {
+	/* the whole record, values included, a multiple of 8 */
+	uint32_t size;
+	uint32_t iface;
+	uint32_t device;
+	uint32_t subdevice;
+	uint32_t index;
+	uint32_t type;
+	uint32_t count;
+	/* snd_ctl_card_info_get_id(): stable when cards come up in another order */
+	char card_id[16];
+	char name[44];
+	int64_t values[];
+};
+
+/*
+ * Map path. If it was saved before this boot, the hardware needs its
+ * values back: a child process restores them while state_tree() answers
+ * for the cards.
+ */
+extern int state_open (const char *path);
+
+/* whether state_tree() still answers */
+extern int state_restoring (void);
+
+/* the saved tree, marked stale, while the restore runs; NULL once live */
+extern json_t* state_tree (void);
+
+/* a child was reaped: if it was the restore, it is over, however it ended */
+extern void state_child (pid_t pid, int status);
+
+/* write path when the state changed and STATE_INTERVAL passed, or now if force */
+extern void state_save (const char *path, int force);
+
+#endif
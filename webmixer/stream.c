@@ -0,0 +1,424 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+
+/* cards sit two or three levels down, /alsa wrapped in NDJSON lines */
+#define MAX_DEPTH 32
+#define MAX_KEY 64
+
+struct frame {
+	int object;
+	/* object: the next string is a member name */
+	int want_key;
+	/* array: the "mixer" of a card, its objects are elements */
+	int mixer;
+	char key[MAX_KEY];
+	/* object: its string members so far, NULL while none */
+	json_t *members;
+	/* object: a card whose header was incomplete, its elements so far */
+	json_t *held;
+};
+
+enum lex {
+	LEX_NONE,
+	LEX_STRING,
+	LEX_LITERAL,
+};
+
+struct stream {
+	const struct stream_ops *ops;
+	void *data;
+
+	struct frame stack[MAX_DEPTH];
+	int depth;
+
+	/* a string (quotes included) or literal read outside elements */
+	enum lex lex;
+	char *token;
+	size_t token_len;
+	size_t token_size;
+
+	/* the element being captured, its bytes and open brackets */
+	char *capture;
+	size_t capture_len;
+	size_t capture_size;
+	int capture_depth;
+	int in_string;
+	int escape;
+
+	size_t offset;
+	/* room for a json_error_t text and where */
+	char error[256];
+};
+
+
+static void
+append (char **buf, size_t *len, size_t *size, const char *data, size_t n)
+{
+	if (*len + n > *size) {
+		*size = (*len + n) * 2;
+		*buf = realloc(*buf, *size);
+	}
+
+	memcpy(*buf + *len, data, n);
+	*len += n;
+}
+
+static int
+fail (struct stream *s, const char *what)
+{
+	snprintf(s->error, sizeof s->error, "%s at byte %zu", what, s->offset);
+	return -1;
+}
+
+struct stream*
+stream_new (const struct stream_ops *ops, void *data)
+{
+	struct stream *s = calloc(1, sizeof *s);
+
+	s->ops = ops;
+	s->data = data;
+
+	return s;
+}
+
+void
+stream_free (struct stream *s)
+{
+	while (s->depth > 0) {
+		s->depth--;
+		json_decref(s->stack[s->depth].members);
+		json_decref(s->stack[s->depth].held);
+	}
+
+	free(s->token);
+	free(s->capture);
+	free(s);
+}
+
+const char*
+stream_error (const struct stream *s)
+{
+	return s->error;
+}
+
+static struct frame*
+top (struct stream *s)
+{
+	return s->depth > 0 ? &s->stack[s->depth - 1] : NULL;
+}
+
+/* a value at depth 0 ended */
+static void
+value_done (struct stream *s)
+{
+	if (s->depth == 0 && s->ops->end)
+		s->ops->end(s->data);
+}
+
+static int
+push (struct stream *s, int object)
+{
+	struct frame *parent = top(s);
+	struct frame *f;
+
+	if (s->depth == MAX_DEPTH)
+		return fail(s, "nested too deep");
+
+	f = &s->stack[s->depth++];
+	memset(f, 0, sizeof *f);
+	f->object = object;
+	f->want_key = object;
+
+	if (!object && parent && parent->object && !strcmp(parent->key, "mixer")) {
+		f->mixer = 1;
+
+		/* members sorting after "mixer" are yet to come */
+		if (json_object_get(parent->members, "name") == NULL ||
+		    json_object_get(parent->members, "mixername") == NULL) {
+			if (parent->held == NULL)
+				parent->held = json_array();
+		} else if (s->ops->card) {
+			s->ops->card(s->data, parent->members);
+		}
+	}
+
+	return 0;
+}
+
+/* a held card is complete: its header, then its elements */
+static void
+release (struct stream *s, struct frame *f)
+{
+	json_t *card = f->members ? json_incref(f->members) : json_object();
+	json_t *selem;
+	size_t i;
+
+	if (s->ops->card)
+		s->ops->card(s->data, card);
+	json_decref(card);
+
+	json_array_foreach(f->held, i, selem) {
+		if (s->ops->selem)
+			s->ops->selem(s->data, selem);
+	}
+
+	json_decref(f->held);
+	f->held = NULL;
+}
+
+static int
+pop (struct stream *s, int object)
+{
+	struct frame *f = top(s);
+
+	if (f == NULL || f->object != object)
+		return fail(s, "unbalanced brackets");
+
+	if (f->held)
+		release(s, f);
+
+	json_decref(f->members);
+	s->depth--;
+	value_done(s);
+
+	return 0;
+}
+
+/* a string or literal ended: a member name, or a value */
+static int
+token_done (struct stream *s)
+{
+	struct frame *f = top(s);
+	int string = s->lex == LEX_STRING;
+	json_t *value = NULL;
+
+	s->lex = LEX_NONE;
+
+	if (f && f->object && f->want_key) {
+		size_t len = s->token_len - 2;
+
+		if (!string)
+			return fail(s, "expected a member name");
+
+		/* names are plain in a dump; a long or escaped one matches nothing */
+		if (len >= MAX_KEY || memchr(s->token, '\\', s->token_len))
+			len = 0;
+		memcpy(f->key, s->token + 1, len);
+		f->key[len] = '\0';
+		f->want_key = 0;
+
+		return 0;
+	}
+
+	if (f && f->object && string) {
+		if ((value = json_loadb(s->token, s->token_len, JSON_DECODE_ANY, NULL)) == NULL)
+			return fail(s, "invalid string");
+
+		if (f->members == NULL)
+			f->members = json_object();
+		json_object_set_new(f->members, f->key, value);
+	}
+
+	value_done(s);
+
+	return 0;
+}
+
+/* bytes of the element being captured, up to where it closes */
+static size_t
+capture (struct stream *s, const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && s->capture_depth > 0; i++) {
+		char c = buf[i];
+
+		if (s->in_string) {
+			if (s->escape)
+				s->escape = 0;
+			else if (c == '\\')
+				s->escape = 1;
+			else if (c == '"')
+				s->in_string = 0;
+		} else if (c == '"') {
+			s->in_string = 1;
+		} else if (c == '{' || c == '[') {
+			s->capture_depth++;
+		} else if (c == '}' || c == ']') {
+			s->capture_depth--;
+		}
+	}
+
+	append(&s->capture, &s->capture_len, &s->capture_size, buf, i);
+
+	return i;
+}
+
+static int
+selem_done (struct stream *s)
+{
+	json_error_t error;
+	json_t *selem = json_loadb(s->capture, s->capture_len, 0, &error);
+	/* the "mixer" array is on top, its card right below */
+	struct frame *card = &s->stack[s->depth - 2];
+
+	s->capture_len = 0;
+
+	if (selem == NULL)
+		return fail(s, error.text);
+
+	if (card->held)
+		json_array_append(card->held, selem);
+	else if (s->ops->selem)
+		s->ops->selem(s->data, selem);
+	json_decref(selem);
+
+	return 0;
+}
+
+/* the rest of a string or literal token in buf; *done once it ended */
+static size_t
+lex (struct stream *s, const char *buf, size_t len, int *done)
+{
+	size_t i;
+
+	*done = 0;
+
+	for (i = 0; i < len && !*done; i++) {
+		char c = buf[i];
+
+		if (s->lex == LEX_LITERAL) {
+			/* the delimiter is not part of it */
+			if (strchr(" \t\r\n,:]}", c)) {
+				*done = 1;
+				break;
+			}
+		} else if (s->escape) {
+			s->escape = 0;
+		} else if (c == '\\') {
+			s->escape = 1;
+		} else if (c == '"') {
+			*done = 1;
+		}
+	}
+
+	append(&s->token, &s->token_len, &s->token_size, buf, i);
+
+	return i;
+}
+
+int
+stream_feed (struct stream *s, const char *buf, size_t len)
+{
+	size_t i = 0, n;
+
+	while (i < len) {
+		struct frame *f = top(s);
+		char c = buf[i];
+
+		if (s->capture_depth > 0) {
+			n = capture(s, buf + i, len - i);
+			i += n;
+			s->offset += n;
+			if (s->capture_depth == 0 && selem_done(s) < 0)
+				return -1;
+			continue;
+		}
+
+		if (s->lex != LEX_NONE) {
+			int done;
+
+			n = lex(s, buf + i, len - i, &done);
+			i += n;
+			s->offset += n;
+			if (done && token_done(s) < 0)
+				return -1;
+			continue;
+		}
+
+		switch (c) {
+		case ' ': case '\t': case '\r': case '\n':
+			break;
+		case ':':
+			if (f == NULL || !f->object || f->want_key)
+				return fail(s, "unexpected ':'");
+			break;
+		case ',':
+			if (f == NULL)
+				return fail(s, "unexpected ','");
+			f->want_key = f->object;
+			break;
+		case '{':
+			if (f && f->mixer) {
+				s->capture_depth = 1;
+				s->in_string = s->escape = 0;
+				append(&s->capture, &s->capture_len, &s->capture_size, "{", 1);
+			} else if (push(s, 1) < 0) {
+				return -1;
+			}
+			break;
+		case '[':
+			if (push(s, 0) < 0)
+				return -1;
+			break;
+		case '}':
+		case ']':
+			if (pop(s, c == '}') < 0)
+				return -1;
+			break;
+		case '"':
+			s->lex = LEX_STRING;
+			s->token_len = 0;
+			s->escape = 0;
+			append(&s->token, &s->token_len, &s->token_size, buf + i, 1);
+			break;
+		default:
+			s->lex = LEX_LITERAL;
+			s->token_len = 0;
+			append(&s->token, &s->token_len, &s->token_size, buf + i, 1);
+			break;
+		}
+
+		i++;
+		s->offset++;
+	}
+
+	return 0;
+}
+
+int
+stream_finish (struct stream *s)
+{
+	/* a literal at the very end has nothing after it to end it */
+	if (s->lex == LEX_LITERAL && s->depth == 0 && token_done(s) < 0)
+		return -1;
+
+	if (s->depth > 0 || s->lex != LEX_NONE || s->capture_depth > 0)
+		return fail(s, "unexpected end of input");
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <jansson.h>
+
+/*
+ * Mixer dumps read incrementally, in constant memory: the structure
+ * around cards is tokenized byte by byte as it arrives, and only each
+ * element of a card's "mixer" gets parsed whole, once it closed. Any
+ * JSON holding cards goes, /alsa as well as /alsa/cards, and so does a
+ * stream of them (NDJSON or just concatenated).
+ *
+ * A card is an object with a "mixer" array. Its header is made of the
+ * string members that came before "mixer", as webmixer writes them.
+ * When "name" or "mixername" is still missing there, as in a dump with
+ * sorted keys, the card is held whole until its object closes instead.
+ */
+
+struct stream;
+
+struct stream_ops {
+	/* a card's "mixer" begins, or its object ended if held; card holds its members */
+	void (*card) (void *data, json_t *card);
+	/* an element of that "mixer", as soon as its object closed */
+	void (*selem) (void *data, json_t *selem);
+	/* a top-level value ended: one snapshot of the stream */
+	void (*end) (void *data);
+};
+
+extern struct stream* stream_new (const struct stream_ops *ops, void *data);
+extern void stream_free (struct stream *s);
+
+/* -1 on malformed input, see stream_error() */
+extern int stream_feed (struct stream *s, const char *buf, size_t len);
+
+/* the input ended: -1 if in the middle of a value */
+extern int stream_finish (struct stream *s);
+
+extern const char* stream_error (const struct stream *s);
+
+#endif
@@ -0,0 +1,188 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <microhttpd.h>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE (64 * 1024)
+#define MAX_BODY (64 * 1024)
+#define MAX_HEADERS 1024
+
+/* only what changes the response */
+static const char
+*traced_headers[] = {
+	MHD_HTTP_HEADER_ACCEPT,
+	MHD_HTTP_HEADER_ACCEPT_ENCODING,
+	MHD_HTTP_HEADER_IF_NONE_MATCH,
+	MHD_HTTP_HEADER_CONTENT_TYPE,
+};
+
+#define TRACED_HEADERS (sizeof(traced_headers)/sizeof(traced_headers[0]))
+
+struct trace {
+	uint64_t time_us;
+	char *uri;
+
+	char headers[MAX_HEADERS];
+	size_t headers_len;
+
+	char *body;
+	size_t body_len;
+};
+
+static FILE *trace_file;
+static struct timespec trace_epoch;
+static time_t last_flush;
+
+
+static uint64_t
+since_epoch_us (void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - trace_epoch.tv_sec) * 1000000LL +
+	       (now.tv_nsec - trace_epoch.tv_nsec) / 1000;
+}
+
+int
+trace_open (const char *path)
+{
+	if ((trace_file = fopen(path, "w")) == NULL)
+		return -1;
+
+	/* records go out in big writes, flushed at most once a second */
+	setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+	fwrite(TRACE_MAGIC, TRACE_MAGIC_SIZE, 1, trace_file);
+	fflush(trace_file);
+
+	clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+	last_flush = trace_epoch.tv_sec;
+
+	return 0;
+}
+
+int
+trace_enabled (void)
+{
+	return trace_file != NULL;
+}
+
+struct trace*
+trace_start (const char *uri)
+{
+	struct trace *t;
+
+	if (trace_file == NULL)
+		return NULL;
+
+	t = calloc(1, sizeof *t);
+	t->time_us = since_epoch_us();
+	t->uri = strdup(uri);
+
+	return t;
+}
+
+void
+trace_headers (struct trace *t, struct MHD_Connection *connection)
+{
+	int i;
+
+	if (t == NULL)
+		return;
+
+	for (i = 0; i < TRACED_HEADERS; i++) {
+		const char *value = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, traced_headers[i]);
+		int n;
+
+		if (value == NULL)
+			continue;
+
+		n = snprintf(t->headers + t->headers_len, sizeof t->headers - t->headers_len,
+			     "%s: %s\r\n", traced_headers[i], value);
+
+		/* drop a header that does not fit rather than cut it */
+		if (n < 0 || (size_t) n >= sizeof t->headers - t->headers_len)
+			t->headers[t->headers_len] = '\0';
+		else
+			t->headers_len += n;
+	}
+}
+
+void
+trace_body (struct trace *t, const char *data, size_t size)
+{
+	if (t == NULL || size == 0)
+		return;
+
+	if (t->body_len + size > MAX_BODY)
+		size = MAX_BODY - t->body_len;
+
+	t->body = realloc(t->body, t->body_len + size);
+	memcpy(t->body + t->body_len, data, size);
+	t->body_len += size;
+}
+
+void
+trace_finish (struct trace *t, const char *method, const char *route,
+	      unsigned int status, uint32_t duration_us)
+{
+	struct trace_record record;
+	struct timespec now;
+
+	if (t == NULL)
+		return;
+
+	record.method_len = strlen(method);
+	record.route_len = strlen(route);
+	record.uri_len = strnlen(t->uri, UINT16_MAX);
+	record.headers_len = t->headers_len;
+	record.body_len = t->body_len;
+	record.size = sizeof record + record.method_len + record.route_len +
+		      record.uri_len + record.headers_len + record.body_len;
+	record.status = status;
+	record.time_us = t->time_us;
+	record.duration_us = duration_us;
+
+	fwrite(&record, sizeof record, 1, trace_file);
+	fwrite(method, record.method_len, 1, trace_file);
+	fwrite(route, record.route_len, 1, trace_file);
+	fwrite(t->uri, record.uri_len, 1, trace_file);
+	fwrite(t->headers, record.headers_len, 1, trace_file);
+	fwrite(t->body, record.body_len, 1, trace_file);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != last_flush) {
+		fflush(trace_file);
+		last_flush = now.tv_sec;
+	}
+
+	free(t->uri);
+	free(t->body);
+	free(t);
+}
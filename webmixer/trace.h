@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Trace file: TRACE_MAGIC, then one record per request in completion
+ * order. A record is the header below followed by method, route, uri,
+ * headers and body, back to back and not NUL terminated. headers holds
+ * complete "Name: value\r\n" lines, ready to be sent again. Integers are
+ * in host byte order.
+ */
+#define TRACE_MAGIC "WMTRACE1"
+#define TRACE_MAGIC_SIZE 8
+
+struct trace_record {
+	/* the whole record, this header included */
+	uint32_t size;
+	uint32_t status;
+	/* request arrival, since the trace was opened */
+	uint64_t time_us;
+	uint16_t method_len;
+	uint16_t route_len;
+	uint16_t uri_len;
+	uint16_t headers_len;
+	uint32_t body_len;
+	/* how long webmixer took to answer */
+	uint32_t duration_us;
+};
+
+struct trace;
+struct MHD_Connection;
+
+extern int trace_open (const char *path);
+extern int trace_enabled (void);
+
+/* NULL when not tracing; every call below accepts NULL */
+extern struct trace* trace_start (const char *uri);
+extern void trace_headers (struct trace *t, struct MHD_Connection *connection);
+extern void trace_body (struct trace *t, const char *data, size_t size);
+extern void trace_finish (struct trace *t, const char *method, const char *route,
+			  unsigned int status, uint32_t duration_us);
+
+#endif
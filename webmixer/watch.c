@@ -0,0 +1,471 @@
+/*******************************************************************************
+ * BEGIN COPYRIGHT NOTICE
+ * 
+ * This file is part of program "I-Trigue 2.1 3300 Digital Control"
+ * Copyright 2013-2014  R. Lemos
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * END COPYRIGHT NOTICE
+ ******************************************************************************/
+
+/*
+ * The snapshot is kept as JSON and remembers where on the screen each
+ * element was drawn. A delta renders that one element again and, on a
+ * terminal, rewrites only the lines of it that differ; elements with a
+ * line more or less redraw the lot. What does not fit the terminal is
+ * left out rather than scrolled, so screen lines stay put. Not on a
+ * terminal, each changed element is simply printed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <jansson.h>
+
+#include "amixer.h"
+#include "watch.h"
+
+#define CHUNK (64 * 1024)
+/* webmixer's */
+#define DEFAULT_PORT "8888"
+
+/* where an element is on the screen, and what it reads */
+struct shown {
+	int line;
+	int count;
+	char *text;
+	size_t len;
+};
+
+struct view {
+	json_t *cards;
+	/* per card, per element of its mixer */
+	struct shown **shown;
+	size_t ncards;
+	int tty;
+	int rows;
+
+	struct text out;
+};
+
+struct input {
+	int fd;
+	/* an HTTP response: its header comes first */
+	int http;
+	int status;
+	char *line;
+	size_t line_len;
+	size_t line_size;
+	/* SSE data lines gathered for the next blank line */
+	struct text data;
+};
+
+
+static int
+lines (const char *text, size_t len)
+{
+	int n = 0;
+
+	while (len-- > 0)
+		n += *text++ == '\n';
+
+	return n;
+}
+
+static void
+forget (struct view *v)
+{
+	size_t i, j;
+
+	for (i = 0; i < v->ncards; i++) {
+		json_t *mixer = json_object_get(json_array_get(v->cards, i), "mixer");
+
+		for (j = 0; v->shown[i] && j < json_array_size(mixer); j++)
+			free(v->shown[i][j].text);
+		free(v->shown[i]);
+	}
+
+	free(v->shown);
+	v->shown = NULL;
+	v->ncards = 0;
+}
+
+/* rewrite screen line with text, when it is on the screen */
+static void
+put_line (struct view *v, int line, const char *text, size_t len)
+{
+	if (line >= v->rows - 1)
+		return;
+
+	text_printf(&v->out, "\033[%d;1H\033[2K%.*s", line + 1, (int) len, text);
+}
+
+/* the whole view, from the top of a cleared screen */
+static void
+redraw (struct view *v)
+{
+	struct text block = { NULL, 0, 0 };
+	json_t *card;
+	size_t i, j;
+	int line = 0;
+
+	if (v->tty)
+		text_printf(&v->out, "\033[H\033[2J");
+
+	json_array_foreach(v->cards, i, card) {
+		json_t *mixer = json_object_get(card, "mixer");
+		json_t *selem;
+
+		block.len = 0;
+		amixer_card_header(&block, card);
+
+		json_array_foreach(mixer, j, selem) {
+			struct shown *s = &v->shown[i][j];
+			size_t start = block.len;
+
+			if (json_is_object(selem))
+				amixer_selem(&block, selem);
+
+			free(s->text);
+			s->len = block.len - start;
+			s->text = malloc(s->len + 1);
+			memcpy(s->text, block.data + start, s->len);
+			s->line = line + lines(block.data, start);
+			s->count = lines(s->text, s->len);
+		}
+
+		/* cut at the bottom of the terminal, see above */
+		if (v->tty && line < v->rows - 1) {
+			const char *p = block.data;
+			int n = 0;
+
+			while (p < block.data + block.len && line + n < v->rows - 1) {
+				const char *nl = memchr(p, '\n', block.data + block.len - p);
+
+				p = nl ? nl + 1 : block.data + block.len;
+				n++;
+			}
+			text_printf(&v->out, "%.*s", (int) (p - block.data), block.data);
+		} else if (!v->tty) {
+			text_printf(&v->out, "%.*s", (int) block.len, block.data);
+		}
+
+		line += lines(block.data, block.len);
+	}
+
+	free(block.data);
+}
+
+static void
+snapshot (struct view *v, json_t *cards)
+{
+	struct winsize ws;
+	size_t i;
+
+	forget(v);
+	json_decref(v->cards);
+	v->cards = json_incref(cards);
+
+	v->rows = v->tty && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 ? ws.ws_row : 24;
+
+	v->ncards = json_array_size(cards);
+	v->shown = calloc(v->ncards + 1, sizeof *v->shown);
+	for (i = 0; i < v->ncards; i++) {
+		size_t n = json_array_size(json_object_get(json_array_get(cards, i), "mixer"));
+
+		v->shown[i] = calloc(n + 1, sizeof **v->shown);
+	}
+
+	redraw(v);
+}
+
+static void
+delta (struct view *v, json_t *change)
+{
+	json_int_t card = json_integer_value(json_object_get(change, "card"));
+	json_int_t index = json_integer_value(json_object_get(change, "index"));
+	json_t *selem = json_object_get(change, "selem");
+	json_t *mixer = json_object_get(json_array_get(v->cards, card), "mixer");
+	struct text block = { NULL, 0, 0 };
+	struct shown *s;
+	const char *old, *new;
+
+	if (card < 0 || (size_t) card >= v->ncards || index < 0 ||
+	    (size_t) index >= json_array_size(mixer) || !json_is_object(selem))
+		return;
+
+	json_array_set(mixer, index, selem);
+	s = &v->shown[card][index];
+	amixer_selem(&block, selem);
+
+	if (!v->tty) {
+		text_printf(&v->out, "%.*s", (int) block.len, block.data);
+	} else if (lines(block.data, block.len) != s->count) {
+		redraw(v);
+	} else {
+		int line = s->line;
+
+		/* the lines that changed, most are Playback or Capture values */
+		old = s->text;
+		new = block.data;
+		while (new < block.data + block.len) {
+			const char *old_end = memchr(old, '\n', s->text + s->len - old);
+			const char *new_end = memchr(new, '\n', block.data + block.len - new);
+
+			if (old_end - old != new_end - new || memcmp(old, new, new_end - new))
+				put_line(v, line, new, new_end - new);
+
+			old = old_end + 1;
+			new = new_end + 1;
+			line++;
+		}
+		text_printf(&v->out, "\033[%d;1H", v->rows);
+
+		free(s->text);
+		s->text = block.data;
+		s->len = block.len;
+		return;
+	}
+
+	free(block.data);
+}
+
+static void
+dispatch (struct view *v, const char *json, size_t len)
+{
+	json_t *message = json_loadb(json, len, 0, NULL);
+	json_t *code;
+
+	if (json_is_array(message)) {
+		snapshot(v, message);
+	} else if (json_object_get(message, "selem")) {
+		delta(v, message);
+	} else if ((code = json_object_get(message, "code"))) {
+		fprintf(stderr, "decodejson: %s\n", json_string_value(json_object_get(message, "message")) ?
+			json_string_value(json_object_get(message, "message")) : "error");
+	}
+
+	json_decref(message);
+}
+
+/* one line of the stream, without its end */
+static int
+line (struct view *v, struct input *in, const char *s, size_t len)
+{
+	if (in->http) {
+		if (in->status == 0) {
+			if (sscanf(s, "HTTP/%*d.%*d %d", &in->status) != 1 || in->status != 200) {
+				fprintf(stderr, "decodejson: %.*s\n", (int) len, s);
+				return -1;
+			}
+		} else if (len == 0) {
+			in->http = 0;
+		}
+		return 0;
+	}
+
+	if (len >= 5 && !memcmp(s, "data:", 5)) {
+		s += 5, len -= 5;
+		if (len > 0 && *s == ' ')
+			s++, len--;
+		if (in->data.len > 0)
+			text_printf(&in->data, "\n");
+		text_printf(&in->data, "%.*s", (int) len, s);
+	} else if (len == 0) {
+		if (in->data.len > 0)
+			dispatch(v, in->data.data, in->data.len);
+		in->data.len = 0;
+	} else if (*s == '[' || *s == '{') {
+		/* NDJSON */
+		dispatch(v, s, len);
+	}
+
+	/* event:, id:, retry: and : comments say nothing the data does not */
+	return 0;
+}
+
+static int
+feed (struct view *v, struct input *in, const char *buf, size_t len)
+{
+	while (len > 0) {
+		const char *nl = memchr(buf, '\n', len);
+		size_t n = nl ? (size_t) (nl - buf) : len;
+
+		if (in->line_len + n > in->line_size) {
+			in->line_size = (in->line_len + n) * 2;
+			in->line = realloc(in->line, in->line_size);
+		}
+		memcpy(in->line + in->line_len, buf, n);
+		in->line_len += n;
+
+		if (nl == NULL)
+			break;
+
+		if (in->line_len > 0 && in->line[in->line_len - 1] == '\r')
+			in->line_len--;
+		if (line(v, in, in->line, in->line_len) < 0)
+			return -1;
+		in->line_len = 0;
+
+		buf += n + 1;
+		len -= n + 1;
+	}
+
+	return 0;
+}
+
+static int
+dial (const char *host, const char *port)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *ai, *p;
+	int fd = -1, err;
+
+	if ((err = getaddrinfo(host, port, &hints, &ai)) != 0) {
+		fprintf(stderr, "decodejson: %s: %s\n", host, gai_strerror(err));
+		return -1;
+	}
+
+	for (p = ai; p && fd < 0; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) >= 0 &&
+		    connect(fd, p->ai_addr, p->ai_addrlen) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	freeaddrinfo(ai);
+
+	if (fd < 0)
+		fprintf(stderr, "decodejson: %s:%s: %s\n", host, port, strerror(errno));
+
+	return fd;
+}
+
+/* connect and ask for the stream: HTTP/1.0 has it end with the connection */
+static int
+open_source (const char *source, struct input *in)
+{
+	char host[256], port[16] = DEFAULT_PORT, request[512];
+	const char *path = "/events";
+	int fd;
+
+	if (!strcmp(source, "-")) {
+		in->fd = STDIN_FILENO;
+		return 0;
+	}
+
+	if (!strncmp(source, "unix:", 5)) {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+		snprintf(addr.sun_path, sizeof addr.sun_path, "%s", source + 5);
+		snprintf(host, sizeof host, "localhost");
+
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
+		    connect(fd, (struct sockaddr*) &addr, sizeof addr) < 0) {
+			close(fd);
+			fd = -1;
+		}
+		if (fd < 0)
+			fprintf(stderr, "decodejson: %s: %s\n", source + 5, strerror(errno));
+	} else if (!strncmp(source, "http://", 7)) {
+		const char *s = source + 7;
+		size_t len = strcspn(s, ":/");
+
+		snprintf(host, sizeof host, "%.*s", (int) len, s);
+		s += len;
+		if (*s == ':') {
+			len = strcspn(++s, "/");
+			snprintf(port, sizeof port, "%.*s", (int) len, s);
+			s += len;
+		}
+		if (*s == '/')
+			path = s;
+
+		fd = dial(host, port);
+	} else {
+		fprintf(stderr, "decodejson: %s: not http://, unix: or -\n", source);
+		return -1;
+	}
+
+	if (fd < 0)
+		return -1;
+
+	snprintf(request, sizeof request,
+		 "GET %s HTTP/1.0\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n", path, host);
+	if (write(fd, request, strlen(request)) < 0) {
+		perror("decodejson: request");
+		close(fd);
+		return -1;
+	}
+
+	in->fd = fd;
+	in->http = 1;
+
+	return 0;
+}
+
+int
+watch (const char *source)
+{
+	struct view v = { NULL };
+	struct input in = { -1 };
+	char *buffer;
+	ssize_t n;
+	int ret = 0;
+
+	if (open_source(source, &in) < 0)
+		return 1;
+
+	v.tty = isatty(STDOUT_FILENO);
+	buffer = malloc(CHUNK);
+
+	while ((n = read(in.fd, buffer, CHUNK)) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("decodejson: read");
+			ret = 1;
+			break;
+		}
+
+		if (feed(&v, &in, buffer, n) < 0) {
+			ret = 1;
+			break;
+		}
+
+		/* one write per read, however many changes it held */
+		if (text_write(&v.out, STDOUT_FILENO) < 0)
+			break;
+	}
+
+	text_write(&v.out, STDOUT_FILENO);
+
+	if (in.fd != STDIN_FILENO)
+		close(in.fd);
+	forget(&v);
+	json_decref(v.cards);
+	free(v.out.data);
+	free(in.data.data);
+	free(in.line);
+	free(buffer);
+
+	return ret;
+}
@@ -20,10 +20,74 @@
  * END COPYRIGHT NOTICE
  ******************************************************************************/
 
-extern int run_server (void);
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "trace.h"
+#include "groups.h"
+#include "httpd.h"
+#include "ctl.h"
+
+static void
+usage (const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-d docroot] [-B backtraces-per-second] [-t trace-file]\n"
+		"       [-g groups-file] [-s unix-socket] [-w workers] [-c]\n"
+		"       [-S state-file]\n", argv0);
+}
 
 int
 main (int argc, char *argv[])
 {
-	return run_server();
+	struct server_options options = { ".", NULL, 1, argv };
+	int tracing = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:B:t:g:s:w:cS:")) != -1) {
+		switch (opt) {
+		case 'd':
+			options.docroot = optarg;
+			break;
+		case 'B':
+			error_set_backtrace_rate(atoi(optarg));
+			break;
+		case 't':
+			if (trace_open(optarg) < 0) {
+				perror(optarg);
+				return 1;
+			}
+			tracing = 1;
+			break;
+		case 'g':
+			if (groups_load(optarg) < 0)
+				return 1;
+			break;
+		case 's':
+			options.socket_path = optarg;
+			break;
+		case 'S':
+			options.state_file = optarg;
+			break;
+		case 'c':
+			ctl_enable();
+			break;
+		case 'w':
+			options.workers = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/* workers would interleave their records in the one file */
+	if (tracing && options.workers > 1) {
+		fprintf(stderr, "%s: -t needs a single process, not -w\n", argv[0]);
+		return 1;
+	}
+
+	return run_server(&options);
 }